@@ -0,0 +1,54 @@
+#include "BackgroundStep.hpp"
+#include "Log.hpp"
+#include <chrono>
+#include <utility>
+
+using namespace std::literals::chrono_literals;
+
+BackgroundStep::BackgroundStep(Step step) {
+    this->thread = std::thread([this, step = std::move(step), logStream = &Log::Stream()] {
+        this->run(step, logStream);
+    });
+}
+
+BackgroundStep::~BackgroundStep() noexcept {
+    this->stopSource.request_stop();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+}
+
+void BackgroundStep::run(const Step& step, std::ostream* logStream) noexcept {
+    Log::SetThreadLogStream(logStream);
+    std::exception_ptr err;
+    try {
+        step(this->stopSource.get_token());
+    } catch (...) {
+        err = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->error = err;
+        this->done = true;
+    }
+    this->cond.notify_all();
+}
+
+void BackgroundStep::Join(StopToken stopToken) {
+    if (!this->thread.joinable()) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        // The fallback StopToken has no callbacks, so the wait is bounded
+        while (!this->cond.wait_for(lock, 100ms, [this] { return this->done; })) {
+            if (stopToken.stop_requested()) {
+                this->stopSource.request_stop();
+            }
+        }
+    }
+    this->thread.join();
+    if (this->error) {
+        std::rethrow_exception(std::exchange(this->error, nullptr));
+    }
+}
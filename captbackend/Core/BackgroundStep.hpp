@@ -0,0 +1,33 @@
+#pragma once
+#include "StopToken.hpp"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs a step on a background thread until Join(), which rethrows its exception.
+// The step gets a token of its own: Join() stops it when the token of the caller is stopped,
+// and it is stopped and joined on destruction, e.g. when the job fails before Join().
+class BackgroundStep {
+public:
+    using Step = std::function<void(StopToken stopToken)>;
+private:
+    StopSource stopSource;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+    std::exception_ptr error;
+    std::thread thread;
+
+    void run(const Step& step, std::ostream* logStream) noexcept;
+public:
+    explicit BackgroundStep(Step step);
+    ~BackgroundStep() noexcept;
+
+    BackgroundStep(const BackgroundStep&) = delete;
+    BackgroundStep& operator=(const BackgroundStep&) = delete;
+
+    // Waits for the step, stopping it if stopToken is stopped meanwhile
+    void Join(StopToken stopToken);
+};
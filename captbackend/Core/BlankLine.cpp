@@ -0,0 +1,112 @@
+#include "BlankLine.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLANKLINE_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BLANKLINE_NEON 1
+#include <arm_neon.h>
+#endif
+
+bool IsBlankLineScalar(std::span<const char> line) noexcept {
+    const char* p = line.data();
+    std::size_t size = line.size();
+    for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        if (v != 0) {
+            return false;
+        }
+    }
+    for (; size != 0; p++, size--) {
+        if (*p != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef BLANKLINE_X86
+__attribute__((target("sse2")))
+static bool isBlankLineSse2(std::span<const char> line) noexcept {
+    const char* p = line.data();
+    std::size_t size = line.size();
+    const __m128i zero = _mm_setzero_si128();
+    for (; size >= 64; p += 64, size -= 64) {
+        __m128i acc = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16))),
+            _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)))
+        );
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    for (; size >= 16; p += 16, size -= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    return IsBlankLineScalar({p, size});
+}
+
+__attribute__((target("avx2")))
+static bool isBlankLineAvx2(std::span<const char> line) noexcept {
+    const char* p = line.data();
+    std::size_t size = line.size();
+    for (; size >= 128; p += 128, size -= 128) {
+        __m256i acc = _mm256_or_si256(
+            _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32))),
+            _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96)))
+        );
+        if (!_mm256_testz_si256(acc, acc)) {
+            return false;
+        }
+    }
+    for (; size >= 32; p += 32, size -= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        if (!_mm256_testz_si256(v, v)) {
+            return false;
+        }
+    }
+    return isBlankLineSse2({p, size});
+}
+#endif
+
+#ifdef BLANKLINE_NEON
+static bool isBlankLineNeon(std::span<const char> line) noexcept {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(line.data());
+    std::size_t size = line.size();
+    for (; size >= 64; p += 64, size -= 64) {
+        uint8x16_t acc = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)), vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+        if (vmaxvq_u8(acc) != 0) {
+            return false;
+        }
+    }
+    return IsBlankLineScalar({reinterpret_cast<const char*>(p), size});
+}
+#endif
+
+using IsBlankLineFn = bool (*)(std::span<const char>) noexcept;
+
+static IsBlankLineFn selectIsBlankLine() noexcept {
+#if defined(BLANKLINE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return isBlankLineAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return isBlankLineSse2;
+    }
+#elif defined(BLANKLINE_NEON)
+    return isBlankLineNeon;
+#endif
+    return IsBlankLineScalar;
+}
+
+bool IsBlankLine(std::span<const char> line) noexcept {
+    static const IsBlankLineFn impl = selectIsBlankLine();
+    return impl(line);
+}
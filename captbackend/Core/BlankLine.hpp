@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+#include <span>
+
+// True if the line has no ink (all bytes zero)
+bool IsBlankLine(std::span<const char> line) noexcept;
+
+// Portable implementation, used as a reference for the vectorized ones
+bool IsBlankLineScalar(std::span<const char> line) noexcept;
@@ -1,49 +1,120 @@
 #include "CaptPrinter.hpp"
+#include "BackgroundStep.hpp"
+#include "LineCropStreambuf.hpp"
+#include "PageCache.hpp"
+#include "PagePipeline.hpp"
+#include "RasterPage.hpp"
 #include "StatusMessage.hpp"
 #include "Log.hpp"
+#include <algorithm>
 #include <cassert>
-#include <libcapt/Utility/Crop.hpp>
-#include <libcapt/Utility/CropStreambuf.hpp>
-#include <libcapt/Compression/ScoaStreambuf.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
 
 using namespace std::literals::chrono_literals;
 
-static inline Capt::Utility::CropStreambuf crop(RasterStreambuf& rasterStr, Capt::PageParams& params) noexcept {
-    uint16_t lineSize = Capt::Utility::CropLineSize(params.ImageLineSize, params.PaperWidth);
-    uint16_t lines = Capt::Utility::CropLinesCount(params.ImageLines, params.PaperHeight);
-    Capt::Utility::CropStreambuf cropStr(rasterStr, params.ImageLineSize, params.ImageLines, lineSize, lines);
-    Log::Debug() << "Cropping raster from " << params.ImageLineSize << 'x' << params.ImageLines
-        << " to " << lineSize << 'x' << lines;
-    params.ImageLineSize = lineSize;
-    params.ImageLines = lines;
-    return cropStr;
+static PageBuffer encodeCached(Capt::Compression::ScoaStreambuf& encoder, PageCache& cache, PageStore& store, unsigned pageNumber, const Capt::PageParams& params, RasterPage& raster, const PageSink* sink) {
+    PageCache::Key key = cache.MakeKey(raster.Window(), params);
+    if (PageCache::Data data = cache.Find(key)) {
+        return PageBuffer(pageNumber, params, *data, &store);
+    }
+    PageBuffer page = EncodePage(encoder, pageNumber, params, raster, &store, sink);
+    cache.Insert(key, page.ToString());
+    return page;
 }
 
-CaptPrinter::CaptPrinter(std::iostream& stream, StateReporter& reporter) noexcept
-    : Capt::BasicCaptPrinter<StopTokenType>(stream), reporter(reporter) {}
+static void logPeakMemory() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        Log::Info() << "Peak memory usage: " << usage.ru_maxrss << " KiB";
+    }
+}
+
+// Polls the status in the background while a job is running
+class PollerScope {
+private:
+    StatusPoller& poller;
+public:
+    explicit PollerScope(StatusPoller& poller) : poller(poller) {
+        this->poller.Start();
+    }
+    ~PollerScope() {
+        this->poller.Stop();
+    }
+};
+
+CaptPrinter::CaptPrinter(std::iostream& stream, StateReporter& reporter, const PrintOptions& options) noexcept
+    : Capt::BasicCaptPrinter<StopTokenType>(stream), reporter(reporter), options(options),
+    poller([this] { this->GetStatus(); }, PollScheduler(25ms, 2s), 1s) {}
+
+CaptPrinter::~CaptPrinter() noexcept {
+    this->poller.Stop();
+}
 
 Capt::ExtendedStatus CaptPrinter::GetStatus() {
+    std::lock_guard<std::recursive_mutex> lock(this->ioMutex);
     Capt::ExtendedStatus status = this->Capt::BasicCaptPrinter<StopTokenType>::GetStatus();
     this->reporter.Update(status);
+    this->poller.Publish(status);
     return status;
 }
 
+// Status read after the last command, from the poller if it has one
+Capt::ExtendedStatus CaptPrinter::currentStatus() {
+    std::shared_ptr<const StatusPoller::Snapshot> snapshot = this->poller.Latest();
+    if (snapshot && snapshot->Sequence >= this->freshFrom) {
+        return snapshot->Status;
+    }
+    return this->GetStatus();
+}
+
+// Waits up to timeout for the poller to see a status that satisfies pred, returns the next status in any case
+Capt::ExtendedStatus CaptPrinter::nextStatus(StopTokenType stopToken, const StatusPoller::Predicate& pred, std::chrono::milliseconds timeout) {
+    unsigned long after = std::max(this->freshFrom, this->poller.NextSequence());
+    std::shared_ptr<const StatusPoller::Snapshot> snapshot = this->poller.Wait(stopToken, pred, timeout, after);
+    if (snapshot && snapshot->Sequence >= after) {
+        return snapshot->Status;
+    }
+    // The poller is not running
+    return this->GetStatus();
+}
+
+std::optional<Capt::ExtendedStatus> CaptPrinter::waitPrintEnd(StopTokenType stopToken) {
+    Command command(*this);
+    return this->WaitPrintEnd(stopToken);
+}
+
+// Sleeps unless stopped, the status keeps being polled meanwhile. Requires a running poller.
+void CaptPrinter::pause(StopTokenType stopToken, std::chrono::milliseconds duration) {
+    this->poller.Wait(stopToken, [](const Capt::ExtendedStatus&) { return false; }, duration);
+}
+
 Capt::ExtendedStatus CaptPrinter::WaitReady(StopTokenType stopToken) {
-    Capt::ExtendedStatus status = this->GetStatus();
-    while (!stopToken.stop_requested() && !(status.Ready() && status.PaperAvailableBits != 0)) {
+    auto ready = [](const Capt::ExtendedStatus& status) {
+        return status.Ready() && status.PaperAvailableBits != 0;
+    };
+    Capt::ExtendedStatus status = this->currentStatus();
+    while (!stopToken.stop_requested() && !ready(status)) {
         if (status.ClearErrorNeeded()) {
             Log::Debug() << "Calling ClearError()";
             Log::Debug() << "Status is " << status;
+            Command command(*this);
             this->ClearError(&status);
         }
         Log::Info() << "Stopped (" << StatusMessage(status) << ')';
-        std::this_thread::sleep_for(1s);
-        status = this->GetStatus();
+        // Returns as soon as the poller sees the printer ready, otherwise after a second
+        status = this->nextStatus(stopToken, ready, 1s);
     }
     return status;
 }
 
 void CaptPrinter::PrepareBeforePrint(StopTokenType stopToken, unsigned page) {
+    this->preparedPage.reset();
+    std::chrono::milliseconds retryDelay = 100ms;
     while (true) {
         Capt::ExtendedStatus status = this->WaitReady(stopToken);
         if (stopToken.stop_requested()) {
@@ -51,22 +122,33 @@ void CaptPrinter::PrepareBeforePrint(StopTokenType stopToken, unsigned page) {
         }
         assert(status.Ready());
         if (!status.Online() || status.Start != page) {
-            if (!this->GoOnline(page)) {
+            bool online;
+            {
+                Command command(*this);
+                online = this->GoOnline(page);
+            }
+            if (!online) {
                 Log::Warning() << "GoOnline failed, retrying...";
-                std::this_thread::sleep_for(1s);
+                this->pause(stopToken, retryDelay);
+                retryDelay = std::min(retryDelay * 2, std::chrono::milliseconds(2s));
                 continue;
             }
         }
+        this->preparedPage = page;
         break;
     }
 }
 
 // Has value if error
-std::optional<Capt::ExtendedStatus> CaptPrinter::WritePage(StopTokenType stopToken, Capt::Utility::BufferedPage& page, Capt::Utility::BufferedPage* prev) {
+std::optional<Capt::ExtendedStatus> CaptPrinter::WritePage(StopTokenType stopToken, PageBuffer& page, PageBuffer* prev, PageTee* tee) {
     Capt::ReprintStatus reprint = Capt::ReprintStatus::None;
     while (!stopToken.stop_requested()) {
-        Capt::Utility::BufferedPage& p = (prev && reprint == Capt::ReprintStatus::Prev) ? *prev : page;
+        PageBuffer& p = (prev && reprint == Capt::ReprintStatus::Prev) ? *prev : page;
+        // The first transmission of a streamed page reads straight from the encoder
+        PageTee* first = &p == &page ? std::exchange(tee, nullptr) : nullptr;
         p.pubseekpos(0);
+        // Only checks the status if the engine was prepared while the page was being compressed
+        bool early = this->preparedPage == p.PageNumber;
         this->PrepareBeforePrint(stopToken, p.PageNumber);
         if (stopToken.stop_requested()) {
             return std::nullopt;
@@ -76,14 +158,33 @@ std::optional<Capt::ExtendedStatus> CaptPrinter::WritePage(StopTokenType stopTok
         } else {
             Log::Info() << "Writing page " << (p.PageNumber + 1);
         }
-        if (this->WriteVideoData(stopToken, p.Params, p)) {
+        if (this->lastDataEnd) {
+            auto gap = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - *this->lastDataEnd);
+            Log::Debug() << "Inter-page gap before page " << (p.PageNumber + 1) << ": " << gap.count() << " ms"
+                << (early ? " (engine prepared early)" : "");
+            this->gapTotal += gap;
+            this->gapCount++;
+        }
+        bool written;
+        {
+            Command command(*this);
+            written = first != nullptr ? this->WriteVideoData(stopToken, p.Params, *first) : this->WriteVideoData(stopToken, p.Params, p);
+        }
+        // The engine takes the data of the next page only after another GoOnline()
+        this->preparedPage.reset();
+        this->lastDataEnd = std::chrono::steady_clock::now();
+        if (first != nullptr) {
+            page = first->Finish();
+            page.PageNumber = p.PageNumber;
+        }
+        if (written) {
             if (prev && reprint == Capt::ReprintStatus::Prev) {
                 reprint = Capt::ReprintStatus::None;
                 continue;
             }
             break;
         }
-        auto status = this->WaitPrintEnd(stopToken);
+        auto status = this->waitPrintEnd(stopToken);
         if (!status) {
             return std::nullopt;
         }
@@ -92,16 +193,18 @@ std::optional<Capt::ExtendedStatus> CaptPrinter::WritePage(StopTokenType stopTok
         }
         reprint = status->GetReprintStatus();
         assert(!status->Ready());
-        std::this_thread::sleep_for(1s);
+        // PrepareBeforePrint() waits for the rest
+        this->nextStatus(stopToken, [](const Capt::ExtendedStatus& s) { return s.Ready(); }, 1s);
     }
     return std::nullopt;
 }
 
 // Has value if error
-std::optional<Capt::ExtendedStatus> CaptPrinter::WaitLastPage(StopTokenType stopToken, Capt::Utility::BufferedPage& page) {
+std::optional<Capt::ExtendedStatus> CaptPrinter::WaitLastPage(StopTokenType stopToken, PageBuffer& page) {
     while (!stopToken.stop_requested()) {
-        std::this_thread::sleep_for(1s);
-        auto status = this->WaitPrintEnd(stopToken);
+        // The engine takes the last page before it reports the end of printing
+        this->nextStatus(stopToken, [](const Capt::ExtendedStatus& s) { return s.IsPrinting() || s.FatalError(); }, 1s);
+        auto status = this->waitPrintEnd(stopToken);
         if (!status) {
             return std::nullopt;
         }
@@ -119,43 +222,243 @@ std::optional<Capt::ExtendedStatus> CaptPrinter::WaitLastPage(StopTokenType stop
 }
 
 bool CaptPrinter::Print(StopTokenType stopToken, RasterStreambuf& rasterStr) {
+    PollerScope pollerScope(this->poller);
+    this->preparedPage.reset();
+    this->lastDataEnd.reset();
+    this->gapTotal = {};
+    this->gapCount = 0;
+    auto printStart = std::chrono::steady_clock::now();
+    // The engine warms up for the first page while the filters produce it and the pipeline compresses it.
+    // The step has a token of its own, Join() and leaving Print() stop it.
+    std::optional<BackgroundStep> warmup;
+    if (this->options.PrepareEarly) {
+        warmup.emplace([this](StopToken warmupStop) {
+            this->PrepareBeforePrint(warmupStop, 0);
+        });
+    }
     unsigned page = 0;
-    Capt::Utility::BufferedPage prevPage;
-    Capt::Compression::ScoaStreambuf ss;
-    while (!stopToken.stop_requested()) {
-        std::optional<Capt::PageParams> params = rasterStr.NextPage();
-        if (!params) {
-            break;
+    PageStore store(this->options.PageMemory);
+    RasterPagePool rasterPages;
+    PageBuffer prevPage;
+    std::optional<PageCache> cache;
+    if (this->options.PageCacheMemory != 0) {
+        cache.emplace(this->options.PageCacheMemory, this->options.PageCacheDir, this->options.PageCacheDisk);
+    }
+    unsigned rasterPageCount = 0;
+    unsigned readPages = 0;
+    // Streamed pages are sent while they are compressed, so nothing can be compressed ahead of them
+    unsigned lookahead = this->options.StreamPages ? 0 : this->options.LookaheadPages;
+    PageSink sink;
+    const PageSink* streamSink = this->options.StreamPages ? &sink : nullptr;
+    // Without look-ahead the page is compressed right away, straight from the reader's buffer.
+    // Opt-in: the defaults trim and cache the pages, which needs a copy of them (see README).
+    bool direct = lookahead == 0 && !this->options.TrimBlank && !this->options.SkipBlankPages
+        && !this->options.Draft && !cache;
+    PagePipeline pipeline([&]() -> std::optional<PagePipeline::Job> {
+        while (true) {
+            std::optional<Capt::PageParams> params = rasterStr.NextPage();
+            if (!params) {
+                return std::nullopt;
+            }
+            CropPageParams(*params);
+            if (rasterPageCount++ == 0) {
+                // Page buffers are sized from the geometry of the first page, a compressed page is never larger than its raster
+                store.Prefill(PagePipeline::PageMemory(*params));
+            }
+            if (direct) {
+                return PagePipeline::Job{*params, [&rasterStr, &store, streamSink, pageNumber = readPages++, params = *params](Capt::Compression::ScoaStreambuf& encoder) {
+                    LineCropStreambuf cropStr(rasterStr, params.ImageLineSize, params.ImageLines);
+                    PageBuffer page = EncodePage(encoder, pageNumber, params, cropStr, &store, streamSink);
+                    cropStr.Drain();
+                    return page;
+                }};
+            }
+
+            std::unique_ptr<RasterPage> rasterPage = rasterPages.Acquire();
+            rasterPage->Load(rasterStr, params->ImageLineSize, params->ImageLines);
+            if (this->options.Draft && params->Resolution == Capt::ResolutionIdx::RES_600) {
+                // Also halves the margins, the page is printed at 300 dpi
+                rasterPage->Downsample(*params);
+            }
+            auto [top, bottom] = rasterPage->BlankBands();
+            if (top == rasterPage->Lines()) {
+                if (this->options.SkipBlankPages) {
+                    Log::Info() << "Skipping blank page " << rasterPageCount;
+                    rasterPages.Release(std::move(rasterPage));
+                    continue;
+                }
+                // The printer still has to feed the sheet
+                top = 0;
+                bottom = rasterPage->Lines() != 0 ? rasterPage->Lines() - 1 : 0;
+            }
+            if (!this->options.TrimBlank) {
+                top = 0;
+                bottom = 0;
+            }
+            if (top != 0 || bottom != 0) {
+                Log::Debug() << "Trimming " << top << " blank lines at the top and " << bottom << " at the bottom";
+                params->MarginTop = static_cast<uint16_t>(params->MarginTop + top);
+                params->ImageLines = static_cast<uint16_t>(params->ImageLines - top - bottom);
+            }
+            rasterPage->SetWindow(top, params->ImageLines);
+            return PagePipeline::Job{*params, [&cache, &store, &rasterPages, streamSink, rasterPage = std::move(rasterPage), pageNumber = readPages++, params = *params](Capt::Compression::ScoaStreambuf& encoder) mutable {
+                PageBuffer page = cache
+                    ? encodeCached(encoder, *cache, store, pageNumber, params, *rasterPage, streamSink)
+                    : EncodePage(encoder, pageNumber, params, *rasterPage, &store, streamSink);
+                rasterPages.Release(std::move(rasterPage));
+                return page;
+            }};
+        }
+    }, lookahead, this->options.LookaheadMemory, this->options.EncoderThreads, this->options.Encoders);
+
+    // Time to first byte: from asking the pipeline for a page until its data can be sent
+    std::optional<std::chrono::steady_clock::time_point> requested;
+    std::chrono::milliseconds firstPageReady{};
+    std::chrono::milliseconds laterPagesReady{};
+    unsigned readyCount = 0;
+
+    // Pages are numbered in the order they are printed, copies included
+    auto printPage = [&](PageBuffer& currPage, PageTee* tee = nullptr) {
+        if (requested) {
+            auto ready = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - *std::exchange(requested, std::nullopt));
+            Log::Debug() << "Data of page " << (page + 1) << " ready " << ready.count() << " ms after it was requested";
+            (readyCount++ == 0 ? firstPageReady : laterPagesReady) += ready;
+        }
+        if (warmup) {
+            warmup->Join(stopToken);
+            warmup.reset();
         }
-        Capt::Utility::CropStreambuf cropStr = crop(rasterStr, *params);
-        ss.Reset(cropStr, params->ImageLineSize, params->ImageLines);
-        Capt::Utility::BufferedPage currPage(page, *params, &ss);
+        currPage.PageNumber = page;
+        const Capt::PageParams& params = currPage.Params;
         reporter.Page(page + 1);
-        Log::Debug() << "Writing page params: ImageSize=" << static_cast<int>(params->ImageLineSize)
-            << 'x' << static_cast<int>(params->ImageLines)
-            << " PaperSize=" << static_cast<int>(params->PaperWidth) << 'x' << static_cast<int>(params->PaperHeight)
-            << " (" << static_cast<int>(params->PaperSize)
-            << ") MarginLeft=" << static_cast<int>(params->MarginLeft) << " MarginTop=" << static_cast<int>(params->MarginTop)
-            << " TonerDensity=" << static_cast<int>(params->TonerDensity) << " Mode=" << static_cast<int>(params->Mode);
-
-        auto res = this->WritePage(stopToken, currPage, page == 0 ? nullptr : &prevPage);
+        Log::Debug() << "Writing page params: ImageSize=" << static_cast<int>(params.ImageLineSize)
+            << 'x' << static_cast<int>(params.ImageLines)
+            << " PaperSize=" << static_cast<int>(params.PaperWidth) << 'x' << static_cast<int>(params.PaperHeight)
+            << " (" << static_cast<int>(params.PaperSize)
+            << ") MarginLeft=" << static_cast<int>(params.MarginLeft) << " MarginTop=" << static_cast<int>(params.MarginTop)
+            << " TonerDensity=" << static_cast<int>(params.TonerDensity) << " Mode=" << static_cast<int>(params.Mode);
+
+        auto start = std::chrono::steady_clock::now();
+        auto res = this->WritePage(stopToken, currPage, page == 0 ? nullptr : &prevPage, tee);
         if (res.has_value()) {
             Log::Debug() << "WritePage failed: " << *res;
             Log::Critical() << "Failed to write page (" << StatusMessage(*res) << ')';
             return false;
         }
+        Log::Debug() << "Page " << (page + 1) << " written in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms";
+        if (page == 0) {
+            Log::Info() << "First page sent " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - printStart).count() << " ms after the start of printing";
+        }
         prevPage = std::move(currPage);
         page++;
+        return true;
+    };
+    // Set when the last page from the pipeline has already been printed by the sink
+    std::optional<bool> streamed;
+    if (streamSink != nullptr) {
+        Log::Debug() << "Sending pages while they are compressed";
+        sink = [&](PageTee& tee) {
+            PageBuffer currPage;
+            currPage.Params = tee.Params;
+            streamed = printPage(currPage, &tee);
+        };
     }
+    // Copies share the compressed data
+    auto replay = [&](const PageBuffer& original) {
+        PageBuffer copy = original;
+        return printPage(copy);
+    };
+
+    unsigned copies = std::max(this->options.Copies, 1u);
+    bool collate = this->options.Collate && copies > 1;
+    std::vector<PageBuffer> retainedPages;
+    if (copies > 1) {
+        Log::Debug() << "Printing " << copies << (collate ? " collated" : " uncollated") << " copies";
+    }
+    while (!stopToken.stop_requested()) {
+        // The next page has been read, so the engine can get ready for it while it is compressed
+        if (this->options.PrepareEarly && page != 0 && !streamSink && pipeline.Pending() != 0) {
+            this->PrepareBeforePrint(stopToken, page);
+        }
+        requested = std::chrono::steady_clock::now();
+        std::optional<PageBuffer> currPage = pipeline.Next(stopToken);
+        if (!currPage) {
+            break;
+        }
+        std::optional<bool> printed = std::exchange(streamed, std::nullopt);
+        if (printed && !*printed) {
+            return false;
+        }
+        if (copies == 1) {
+            if (!printed && !printPage(*currPage)) {
+                return false;
+            }
+            continue;
+        }
+        if (collate) {
+            retainedPages.push_back(*currPage);
+            if (!printed && !printPage(*currPage)) {
+                return false;
+            }
+            continue;
+        }
+        PageBuffer original = *currPage;
+        if (!printed && !printPage(*currPage)) {
+            return false;
+        }
+        for (unsigned copy = 1; copy < copies && !stopToken.stop_requested(); copy++) {
+            if (!replay(original)) {
+                return false;
+            }
+        }
+    }
+    pipeline.Stop();
+    for (unsigned copy = 1; copy < copies && !retainedPages.empty(); copy++) {
+        Log::Info() << "Printing copy " << (copy + 1) << " of " << copies;
+        for (const PageBuffer& retained : retainedPages) {
+            if (stopToken.stop_requested()) {
+                break;
+            }
+            if (!replay(retained)) {
+                return false;
+            }
+        }
+    }
+    if (cache) {
+        cache->LogStats();
+    }
+    store.LogStats();
+    if (readyCount != 0) {
+        // Pages are compressed in parallel, but each one on a single thread
+        auto log = Log::Info();
+        log << "Time to first byte: page 1 " << firstPageReady.count() << " ms";
+        if (readyCount > 1) {
+            log << ", later pages " << (laterPagesReady.count() / (readyCount - 1)) << " ms on average";
+        }
+        log << " (" << (streamSink ? "streamed" : "buffered") << " pages, look-ahead " << lookahead << ')';
+    }
+    if (this->gapCount != 0) {
+        Log::Info() << "Average inter-page gap: " << (this->gapTotal.count() / this->gapCount) << " ms over "
+            << this->gapCount << " pages (early engine preparation " << (this->options.PrepareEarly ? "on" : "off") << ')';
+    }
+    logPeakMemory();
+    // Only left when the job had no pages
+    warmup.reset();
 
     Log::Info() << "Waiting for last page...";
     if (page != 0) {
+        auto start = std::chrono::steady_clock::now();
         auto res = this->WaitLastPage(stopToken, prevPage);
         if (res.has_value()) {
             Log::Debug() << "WaitLastPage failed: " << *res;
             Log::Critical() << "Failed to write page (" << StatusMessage(*res) << ')';
             return false;
         }
+        Log::Debug() << "Last page finished in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms";
     }
     Capt::ExtendedStatus status = this->GetStatus();
     Log::Debug() << "Status after CaptPrinter::Print(): " << status;
@@ -163,14 +466,21 @@ bool CaptPrinter::Print(StopTokenType stopToken, RasterStreambuf& rasterStr) {
 }
 
 bool CaptPrinter::Clean(StopTokenType stopToken) {
+    PollerScope pollerScope(this->poller);
     while (!stopToken.stop_requested()) {
         this->PrepareBeforePrint(stopToken, 0);
-        std::this_thread::sleep_for(1s); // Manual slot delay
-        this->Cleaning();
+        this->pause(stopToken, 1s); // Manual slot delay
+        if (stopToken.stop_requested()) {
+            break;
+        }
+        {
+            Command command(*this);
+            this->Cleaning();
+        }
         Log::Info() << "Cleaning...";
-        std::this_thread::sleep_for(2s);
-
-        Capt::ExtendedStatus status = this->GetStatus();
+        Capt::ExtendedStatus status = this->nextStatus(stopToken, [](const Capt::ExtendedStatus& s) {
+            return (s.Engine & Capt::EngineReadyStatus::CLEANING) != 0 || s.FatalError();
+        }, 2s);
         if (status.FatalError()) {
             Log::Debug() << "Clean failed: " << status;
             Log::Critical() << "Unknown fatal error";
@@ -180,7 +490,7 @@ bool CaptPrinter::Clean(StopTokenType stopToken) {
             Log::Warning() << "Cleaning failed (" << StatusMessage(status) << ')';
             continue;
         }
-        this->WaitPrintEnd(stopToken);
+        this->waitPrintEnd(stopToken);
         break;
     }
     Capt::ExtendedStatus status = this->GetStatus();
@@ -1,27 +1,67 @@
 #pragma once
+#include "PageBuffer.hpp"
+#include "PrintOptions.hpp"
 #include "RasterStreambuf.hpp"
 #include "StateReporter.hpp"
+#include "StatusPoller.hpp"
 #include "StopToken.hpp"
 #include <libcapt/BasicCaptPrinter.hpp>
-#include <libcapt/Utility/BufferedPage.hpp>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <optional>
 
 class CaptPrinter : public Capt::BasicCaptPrinter<StopToken> {
 private:
     StateReporter& reporter;
+    PrintOptions options;
+
+    // Serializes the status poller with the commands sent by the printing thread
+    std::recursive_mutex ioMutex;
+    StatusPoller poller;
+    // Statuses published before this one may predate the last command
+    unsigned long freshFrom = 0;
+    // Page the engine has been brought online for, until its data is sent
+    std::optional<unsigned> preparedPage;
+
+    // Time between the end of the data of a page and the start of the next one
+    std::optional<std::chrono::steady_clock::time_point> lastDataEnd;
+    std::chrono::milliseconds gapTotal{};
+    unsigned gapCount = 0;
+
+    // Holds the stream for a command, statuses read before it are stale afterwards
+    class Command {
+    private:
+        CaptPrinter& printer;
+        std::lock_guard<std::recursive_mutex> lock;
+    public:
+        explicit Command(CaptPrinter& printer) : printer(printer), lock(printer.ioMutex) {}
+        ~Command() {
+            this->printer.freshFrom = this->printer.poller.NextSequence();
+            this->printer.poller.Kick();
+        }
+    };
+
+    Capt::ExtendedStatus currentStatus();
+    Capt::ExtendedStatus nextStatus(StopTokenType stopToken, const StatusPoller::Predicate& pred, std::chrono::milliseconds timeout);
+    std::optional<Capt::ExtendedStatus> waitPrintEnd(StopTokenType stopToken);
+    void pause(StopTokenType stopToken, std::chrono::milliseconds duration);
 public:
-    explicit CaptPrinter(std::iostream& stream, StateReporter& reporter) noexcept;
+    explicit CaptPrinter(std::iostream& stream, StateReporter& reporter, const PrintOptions& options = {}) noexcept;
+    ~CaptPrinter() noexcept;
 
+    // Reads the status from the printer and publishes it to the status poller
     Capt::ExtendedStatus GetStatus() override;
 
     Capt::ExtendedStatus WaitReady(StopTokenType stopToken);
     void PrepareBeforePrint(StopTokenType stopToken, unsigned page);
 
-    // Has value if error
-    std::optional<Capt::ExtendedStatus> WritePage(StopTokenType stopToken, Capt::Utility::BufferedPage& page, Capt::Utility::BufferedPage* prev);
+    // Has value if error. If tee is set, the page is first sent from it while it is being compressed
+    // and page is set to the data that went through.
+    std::optional<Capt::ExtendedStatus> WritePage(StopTokenType stopToken, PageBuffer& page, PageBuffer* prev, PageTee* tee = nullptr);
 
     // Has value if error
-    std::optional<Capt::ExtendedStatus> WaitLastPage(StopTokenType stopToken, Capt::Utility::BufferedPage& page);
+    std::optional<Capt::ExtendedStatus> WaitLastPage(StopTokenType stopToken, PageBuffer& page);
 
     bool Print(StopTokenType stopToken, RasterStreambuf& rasterStr);
     bool Clean(StopTokenType stopToken);
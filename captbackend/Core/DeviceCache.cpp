@@ -0,0 +1,115 @@
+#include "DeviceCache.hpp"
+#include "Log.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string_view>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static constexpr std::string_view FileMagic = "CAPTDC1";
+
+// Fields are separated by tabs, entries by newlines
+static inline bool isValidField(std::string_view field) noexcept {
+    return field.find_first_of("\t\n") == std::string_view::npos;
+}
+
+DeviceCache::DeviceCache(fs::path path) : path(std::move(path)) {
+    if (this->path.empty()) {
+        return;
+    }
+    std::ifstream file(this->path);
+    std::string line;
+    if (!file || !std::getline(file, line) || line != FileMagic) {
+        return;
+    }
+    while (std::getline(file, line)) {
+        std::size_t first = line.find('\t');
+        std::size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second == std::string::npos) {
+            Log::Debug() << "Ignoring damaged device cache entry in " << this->path.string();
+            continue;
+        }
+        this->entries.insert_or_assign(line.substr(0, first), Entry{
+            line.substr(second + 1), line.substr(first + 1, second - first - 1), false
+        });
+    }
+}
+
+std::optional<PrinterInfo> DeviceCache::Find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->entries.find(key);
+    if (it == this->entries.end()) {
+        return std::nullopt;
+    }
+    it->second.Used = true;
+    return PrinterInfo::Parse(it->second.DeviceId, it->second.Serial);
+}
+
+void DeviceCache::Insert(const std::string& key, const PrinterInfo& info) {
+    if (this->path.empty() || !isValidField(key) || key.empty() || !isValidField(info.DeviceId) || !isValidField(info.Serial)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.insert_or_assign(key, Entry{info.DeviceId, info.Serial, true});
+    this->dirty = true;
+}
+
+void DeviceCache::Prune() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::erase_if(this->entries, [this](const auto& entry) {
+        if (entry.second.Used) {
+            return false;
+        }
+        this->dirty = true;
+        return true;
+    });
+}
+
+void DeviceCache::Erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->entries.erase(key) != 0) {
+        this->dirty = true;
+    }
+}
+
+void DeviceCache::Clear() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->entries.empty()) {
+        this->entries.clear();
+        this->dirty = true;
+    }
+}
+
+void DeviceCache::Save() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->path.empty() || !this->dirty) {
+        return;
+    }
+    std::error_code ec;
+    fs::create_directories(this->path.parent_path(), ec);
+    std::string tmpPath = this->path.string() + ".XXXXXX";
+    int fd = mkostemp(tmpPath.data(), O_CLOEXEC);
+    if (fd < 0) {
+        Log::Debug() << "Can't create device cache file: " << std::strerror(errno);
+        return;
+    }
+    std::string data(FileMagic);
+    data += '\n';
+    for (const auto& [key, entry] : this->entries) {
+        data.append(key).append(1, '\t').append(entry.Serial).append(1, '\t').append(entry.DeviceId).append(1, '\n');
+    }
+    bool ok = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    ok = close(fd) == 0 && ok;
+    // Concurrent backends see either the old or the new file
+    if (!ok || rename(tmpPath.c_str(), this->path.c_str()) != 0) {
+        Log::Debug() << "Can't write device cache file " << this->path.string();
+        unlink(tmpPath.c_str());
+        return;
+    }
+    this->dirty = false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "PrinterInfo.hpp"
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Identities of the attached printers, so that they are found without control transfers.
+// The key describes the device as seen in its descriptors (see UsbPrinter::CacheKey()).
+// Thread-safe, the file is replaced atomically by Save().
+class DeviceCache {
+private:
+    struct Entry {
+        std::string DeviceId;
+        std::string Serial;
+        bool Used;
+    };
+
+    std::filesystem::path path;
+    std::mutex mutex;
+    std::map<std::string, Entry, std::less<>> entries;
+    bool dirty = false;
+public:
+    // Empty path disables the cache, a missing or damaged file is an empty cache
+    explicit DeviceCache(std::filesystem::path path = {});
+
+    [[nodiscard]] std::optional<PrinterInfo> Find(const std::string& key);
+    void Insert(const std::string& key, const PrinterInfo& info);
+    // Removes the entries not looked up since the cache was loaded
+    void Prune();
+    void Erase(const std::string& key);
+    void Clear();
+
+    void Save();
+};
@@ -0,0 +1,57 @@
+#include "Downsample.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void OrLines(const char* a, const char* b, char* out, std::size_t size) noexcept {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(va, vb));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t va = vld1q_u8(reinterpret_cast<const uint8_t*>(a + i));
+        uint8x16_t vb = vld1q_u8(reinterpret_cast<const uint8_t*>(b + i));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out + i), vorrq_u8(va, vb));
+    }
+#endif
+    for (; i < size; i++) {
+        out[i] = static_cast<char>(a[i] | b[i]);
+    }
+}
+
+// 8 pixels to 4, the leftmost pixel is the most significant bit
+static constexpr std::array<uint8_t, 256> HalveTable = [] {
+    std::array<uint8_t, 256> table{};
+    for (unsigned v = 0; v < 256; v++) {
+        uint8_t res = 0;
+        for (unsigned pair = 0; pair < 4; pair++) {
+            if ((v >> (6 - 2 * pair)) & 0x3) {
+                res |= 0x8 >> pair;
+            }
+        }
+        table[v] = res;
+    }
+    return table;
+}();
+
+void HalveLine(const char* in, char* out, std::size_t size) noexcept {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(in);
+    std::size_t i = 0;
+    // out[i / 2] only overwrites bytes that have already been read
+    for (; i + 2 <= size; i += 2) {
+        out[i / 2] = static_cast<char>((HalveTable[src[i]] << 4) | HalveTable[src[i + 1]]);
+    }
+    if (i < size) {
+        out[i / 2] = static_cast<char>(HalveTable[src[i]] << 4);
+    }
+}
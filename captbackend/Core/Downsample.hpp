@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+// 2:1 downsampling of 1-bit raster, the pixel is black if any of the 2x2 source pixels is black.
+// A line is made with OrLines() followed by HalveLine().
+
+// out = a | b, out may alias a or b
+void OrLines(const char* a, const char* b, char* out, std::size_t size) noexcept;
+
+// Halves the line horizontally into (size + 1) / 2 bytes, out may alias in
+void HalveLine(const char* in, char* out, std::size_t size) noexcept;
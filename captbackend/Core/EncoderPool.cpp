@@ -0,0 +1,55 @@
+#include "EncoderPool.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <utility>
+
+EncoderPool::EncoderPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        this->threads.emplace_back(&EncoderPool::run, this);
+    }
+}
+
+EncoderPool::~EncoderPool() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->cond.notify_all();
+    for (std::thread& thread : this->threads) {
+        thread.join();
+    }
+}
+
+unsigned EncoderPool::Threads() const noexcept {
+    return static_cast<unsigned>(this->threads.size());
+}
+
+void EncoderPool::Submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->tasks.push_back(Entry{std::move(task), &Log::Stream()});
+    }
+    this->cond.notify_one();
+}
+
+void EncoderPool::run() noexcept {
+    Capt::Compression::ScoaStreambuf encoder;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->cond.wait(lock, [this] { return this->stopped || !this->tasks.empty(); });
+        if (this->tasks.empty()) {
+            break;
+        }
+        Entry entry = std::move(this->tasks.front());
+        this->tasks.pop_front();
+        lock.unlock();
+        Log::SetThreadLogStream(entry.LogStream);
+        entry.Run(encoder);
+        entry.Run = nullptr;
+        Log::SetThreadLogStream(nullptr);
+        lock.lock();
+    }
+}
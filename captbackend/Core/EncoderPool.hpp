@@ -0,0 +1,43 @@
+#pragma once
+#include <libcapt/Compression/ScoaStreambuf.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads compressing pages for several page pipelines at once (see PagePipeline),
+// so that jobs running side by side share the CPU cores instead of starting threads for each.
+// Tasks run in the order they are submitted, a pipeline has at most its depth of them queued.
+class EncoderPool {
+public:
+    // Each thread has its own encoder
+    using Task = std::move_only_function<void(Capt::Compression::ScoaStreambuf& encoder)>;
+private:
+    struct Entry {
+        Task Run;
+        // Log stream of the submitting thread
+        std::ostream* LogStream;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Entry> tasks;
+    bool stopped = false;
+    std::vector<std::thread> threads;
+
+    void run() noexcept;
+public:
+    // threads == 0 starts one thread per CPU core
+    explicit EncoderPool(unsigned threads = 0);
+    // Runs the tasks already submitted
+    ~EncoderPool() noexcept;
+
+    EncoderPool(const EncoderPool&) = delete;
+    EncoderPool& operator=(const EncoderPool&) = delete;
+
+    // Task must not throw
+    void Submit(Task task);
+    [[nodiscard]] unsigned Threads() const noexcept;
+};
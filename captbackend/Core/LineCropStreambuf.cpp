@@ -0,0 +1,32 @@
+#include "LineCropStreambuf.hpp"
+#include "RasterError.hpp"
+#include <span>
+
+using int_type = LineCropStreambuf::int_type;
+
+LineCropStreambuf::LineCropStreambuf(RasterStreambuf& src, std::size_t lineSize, unsigned lines) noexcept
+    : src(src), lineSize(lineSize), linesRemain(lines) {}
+
+int_type LineCropStreambuf::underflow() {
+    if (this->gptr() < this->egptr()) {
+        return traits_type::to_int_type(*this->gptr());
+    }
+    if (this->linesRemain == 0) {
+        return traits_type::eof();
+    }
+    std::span<const char> line = this->src.NextLine();
+    if (line.size() < this->lineSize) {
+        throw RasterError("unexpected end of page");
+    }
+    this->linesRemain--;
+    // The get area is never written through
+    char_type* start = const_cast<char_type*>(line.data());
+    this->setg(start, start, start + this->lineSize);
+    return traits_type::to_int_type(*this->gptr());
+}
+
+void LineCropStreambuf::Drain() {
+    this->setg(nullptr, nullptr, nullptr);
+    this->linesRemain = 0;
+    while (!this->src.NextLine().empty()) {}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "RasterStreambuf.hpp"
+#include <cstddef>
+#include <streambuf>
+
+// Crops the page to lineSize x lines on top of RasterStreambuf::NextLine().
+// The get area points straight into the reader's line, nothing is copied.
+class LineCropStreambuf : public std::streambuf {
+private:
+    RasterStreambuf& src;
+    std::size_t lineSize;
+    unsigned linesRemain;
+
+    int_type underflow() override;
+public:
+    explicit LineCropStreambuf(RasterStreambuf& src, std::size_t lineSize, unsigned lines) noexcept;
+
+    // Skips the lines cropped off the bottom of the page
+    void Drain();
+};
@@ -4,14 +4,18 @@
 
 namespace Log {
     static std::ostream* LogStream = &std::clog;
+    // Set by the threads running a job of the daemon, their messages go to the backend of the job
+    static thread_local std::ostream* ThreadLogStream = nullptr;
+    // Serializes messages from the pipeline threads
+    static std::recursive_mutex LogMutex;
 
-    StreamTerminator::StreamTerminator(std::ostream& stream) noexcept
-        : stream(stream) {
+    StreamTerminator::StreamTerminator(std::ostream& stream, std::unique_lock<std::recursive_mutex> lock) noexcept
+        : stream(stream), lock(std::move(lock)) {
         this->state.copyfmt(stream);
     }
 
     StreamTerminator::StreamTerminator(StreamTerminator&& other) noexcept
-        : stream(other.stream) {
+        : stream(other.stream), lock(std::move(other.lock)) {
         this->state.copyfmt(other.state);
         other.terminate = false;
     }
@@ -27,8 +31,21 @@ namespace Log {
         LogStream = &stream;
     }
 
+    void SetThreadLogStream(std::ostream* stream) noexcept {
+        ThreadLogStream = stream;
+    }
+
+    std::ostream& Stream() noexcept {
+        return ThreadLogStream != nullptr ? *ThreadLogStream : *LogStream;
+    }
+
+    std::unique_lock<std::recursive_mutex> Lock() {
+        return std::unique_lock<std::recursive_mutex>(LogMutex);
+    }
+
     StreamTerminator Log(std::string_view level) {
         assert(LogStream != nullptr);
-        return StreamTerminator(*LogStream) << level << ": ";
+        std::unique_lock<std::recursive_mutex> lock(LogMutex);
+        return StreamTerminator(Stream(), std::move(lock)) << level << ": ";
     }
 }
@@ -1,16 +1,18 @@
 #pragma once
 #include <iostream>
+#include <mutex>
 #include <string_view>
 
 namespace Log {
     class StreamTerminator {
     private:
         std::ostream& stream;
+        std::unique_lock<std::recursive_mutex> lock;
         bool terminate = true;
 
         std::ios state = std::ios(nullptr);
     public:
-        explicit StreamTerminator(std::ostream& stream) noexcept;
+        explicit StreamTerminator(std::ostream& stream, std::unique_lock<std::recursive_mutex> lock = {}) noexcept;
         ~StreamTerminator();
 
         StreamTerminator(const StreamTerminator&) = delete;
@@ -32,6 +34,12 @@ namespace Log {
     };
 
     void SetLogStream(std::ostream& stream) noexcept;
+    // Overrides the log stream for the calling thread, nullptr goes back to the one of SetLogStream()
+    void SetThreadLogStream(std::ostream* stream) noexcept;
+    // Stream the calling thread logs to, to be passed to the threads started on behalf of it
+    std::ostream& Stream() noexcept;
+    // Held while a message is written, for other writers to the log stream
+    std::unique_lock<std::recursive_mutex> Lock();
     StreamTerminator Log(std::string_view level);
 
     inline StreamTerminator Debug() { return Log("DEBUG"); }
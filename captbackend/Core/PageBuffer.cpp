@@ -0,0 +1,406 @@
+#include "PageBuffer.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spanstream>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+using int_type = PageBuffer::int_type;
+using pos_type = PageBuffer::pos_type;
+
+static constexpr std::size_t ChunkSize = PageStore::ChunkSize;
+
+PageStore::PageStore(std::size_t budget, std::filesystem::path tmpDir) : budget(budget), tmpDir(std::move(tmpDir)) {
+    if (this->tmpDir.empty()) {
+        std::error_code ec;
+        this->tmpDir = std::filesystem::temp_directory_path(ec);
+        if (ec) {
+            this->tmpDir = "/tmp";
+        }
+    }
+}
+
+void PageStore::Prefill(std::size_t size) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::size_t chunks = std::min(size, this->budget - this->used) / ChunkSize;
+    while (this->freeChunks.size() < chunks) {
+        this->freeChunks.push_back(std::make_unique_for_overwrite<char[]>(ChunkSize));
+        this->allocatedChunks++;
+    }
+}
+
+PageStore::Chunk PageStore::Acquire() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->used + ChunkSize > this->budget) {
+        return nullptr;
+    }
+    this->used += ChunkSize;
+    this->peak = std::max(this->peak, this->used);
+    if (!this->freeChunks.empty()) {
+        Chunk chunk = std::move(this->freeChunks.back());
+        this->freeChunks.pop_back();
+        return chunk;
+    }
+    this->allocatedChunks++;
+    return std::make_unique_for_overwrite<char[]>(ChunkSize);
+}
+
+void PageStore::Recycle(Chunk chunk) noexcept {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->used -= ChunkSize;
+    // Never more than the budget, as every free chunk has been in use at some point
+    this->freeChunks.push_back(std::move(chunk));
+}
+
+int PageStore::CreateTempFile() {
+    int fd;
+#ifdef O_TMPFILE
+    fd = open(this->tmpDir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+    // The file system does not support O_TMPFILE
+    std::string path = (this->tmpDir / "captpage.XXXXXX").string();
+    fd = mkostemp(path.data(), O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "can't create page buffer file");
+    }
+    unlink(path.c_str());
+    return fd;
+}
+
+void PageStore::Spilled(std::size_t size) noexcept {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->spilledPages++;
+    this->spilledBytes += size;
+}
+
+void PageStore::LogStats() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Log::Debug() << "Page buffers: peak " << (this->peak / 1024) << " KiB in memory of " << (this->budget / 1024)
+        << " KiB, " << this->allocatedChunks << " chunks allocated";
+    if (this->spilledPages != 0) {
+        Log::Info() << "Page buffers: " << this->spilledPages << " pages (" << (this->spilledBytes / 1024)
+            << " KiB) kept in temporary files";
+    }
+}
+
+class PageBuffer::Storage {
+private:
+    PageStore* store;
+    std::vector<PageStore::Chunk> chunks;
+    int fd = -1;
+    PageStore::Chunk buffer;
+    void* map = nullptr;
+    std::size_t size = 0;
+
+    PageStore::Chunk acquire();
+    void spill();
+public:
+    explicit Storage(PageStore* store) noexcept : store(store) {}
+    ~Storage() noexcept;
+
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+
+    // Appends the next block of src and returns it, empty at the end of src.
+    // The returned data is valid until the next call.
+    std::string_view Read(std::streambuf& src);
+    // Called after src has been read to the end
+    void Finish();
+
+    std::size_t Size() const noexcept {
+        return this->size;
+    }
+    std::size_t Segments() const noexcept {
+        return this->map != nullptr ? 1 : this->chunks.size();
+    }
+    std::string_view Segment(std::size_t index) const noexcept {
+        if (this->map != nullptr) {
+            return {static_cast<const char*>(this->map), this->size};
+        }
+        std::size_t offset = index * ChunkSize;
+        return {this->chunks[index].get(), std::min(ChunkSize, this->size - offset)};
+    }
+    std::size_t SegmentSize() const noexcept {
+        return this->map != nullptr ? this->size : ChunkSize;
+    }
+    bool Spilled() const noexcept {
+        return this->map != nullptr;
+    }
+};
+
+PageStore::Chunk PageBuffer::Storage::acquire() {
+    if (this->store == nullptr) {
+        return std::make_unique_for_overwrite<char[]>(ChunkSize);
+    }
+    return this->store->Acquire();
+}
+
+PageBuffer::Storage::~Storage() noexcept {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+    if (this->map != nullptr) {
+        munmap(this->map, this->size);
+    }
+    if (this->store != nullptr) {
+        for (PageStore::Chunk& chunk : this->chunks) {
+            this->store->Recycle(std::move(chunk));
+        }
+    }
+}
+
+static void writeAll(int fd, const char* data, std::size_t size) {
+    while (size != 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), "can't write page buffer file");
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+std::string_view PageBuffer::Storage::Read(std::streambuf& src) {
+    if (this->fd < 0) {
+        std::size_t offset = this->size % ChunkSize;
+        if (offset == 0) {
+            if (traits_type::eq_int_type(src.sgetc(), traits_type::eof())) {
+                return {};
+            }
+            PageStore::Chunk chunk = this->acquire();
+            if (chunk != nullptr) {
+                this->chunks.push_back(std::move(chunk));
+            } else {
+                this->spill();
+            }
+        }
+        if (this->fd < 0) {
+            char* data = this->chunks.back().get() + offset;
+            std::streamsize n = src.sgetn(data, static_cast<std::streamsize>(ChunkSize - offset));
+            if (n <= 0) {
+                return {};
+            }
+            this->size += static_cast<std::size_t>(n);
+            return {data, static_cast<std::size_t>(n)};
+        }
+    }
+    std::streamsize n = src.sgetn(this->buffer.get(), static_cast<std::streamsize>(ChunkSize));
+    if (n <= 0) {
+        return {};
+    }
+    writeAll(this->fd, this->buffer.get(), static_cast<std::size_t>(n));
+    this->size += static_cast<std::size_t>(n);
+    return {this->buffer.get(), static_cast<std::size_t>(n)};
+}
+
+// Moves what has been read so far to a temporary file, the rest is appended to it
+void PageBuffer::Storage::spill() {
+    this->fd = this->store->CreateTempFile();
+    for (std::size_t i = 0; i < this->chunks.size(); i++) {
+        writeAll(this->fd, this->chunks[i].get(), this->Segment(i).size());
+    }
+    for (PageStore::Chunk& chunk : this->chunks) {
+        this->store->Recycle(std::move(chunk));
+    }
+    this->chunks.clear();
+    this->buffer = std::make_unique_for_overwrite<char[]>(ChunkSize);
+}
+
+void PageBuffer::Storage::Finish() {
+    if (this->fd < 0) {
+        return;
+    }
+    if (this->size != 0) {
+        void* map = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (map == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "can't map page buffer file");
+        }
+        posix_madvise(map, this->size, POSIX_MADV_SEQUENTIAL);
+        this->map = map;
+    }
+    close(std::exchange(this->fd, -1));
+    this->buffer.reset();
+    this->store->Spilled(this->size);
+}
+
+PageBuffer::PageBuffer() noexcept = default;
+
+PageBuffer::PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::shared_ptr<const Storage> storage) noexcept
+    : storage(std::move(storage)), PageNumber(pageNumber), Params(params) {
+    this->setSegment(0, 0);
+}
+
+PageBuffer::PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::streambuf& src, PageStore* store)
+    : PageNumber(pageNumber), Params(params) {
+    auto storage = std::make_shared<Storage>(store);
+    while (!storage->Read(src).empty()) {}
+    storage->Finish();
+    this->storage = std::move(storage);
+    this->setSegment(0, 0);
+}
+
+PageBuffer::PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::string_view data, PageStore* store)
+    : PageNumber(pageNumber), Params(params) {
+    // Opened for reading only, the data is never written through
+    std::spanbuf src(std::span<char>(const_cast<char*>(data.data()), data.size()), std::ios_base::in);
+    auto storage = std::make_shared<Storage>(store);
+    while (!storage->Read(src).empty()) {}
+    storage->Finish();
+    this->storage = std::move(storage);
+    this->setSegment(0, 0);
+}
+
+PageBuffer::~PageBuffer() noexcept = default;
+
+PageBuffer::PageBuffer(const PageBuffer& other) noexcept
+    : std::streambuf(), storage(other.storage), PageNumber(other.PageNumber), Params(other.Params) {
+    this->setSegment(0, 0);
+}
+
+PageBuffer& PageBuffer::operator=(const PageBuffer& other) noexcept {
+    this->storage = other.storage;
+    this->PageNumber = other.PageNumber;
+    this->Params = other.Params;
+    this->setSegment(0, 0);
+    return *this;
+}
+
+PageBuffer::PageBuffer(PageBuffer&& other) noexcept
+    : std::streambuf(), storage(std::move(other.storage)), PageNumber(other.PageNumber), Params(other.Params) {
+    this->setSegment(0, 0);
+    other.setSegment(0, 0);
+}
+
+PageBuffer& PageBuffer::operator=(PageBuffer&& other) noexcept {
+    this->storage = std::move(other.storage);
+    this->PageNumber = other.PageNumber;
+    this->Params = other.Params;
+    this->setSegment(0, 0);
+    other.setSegment(0, 0);
+    return *this;
+}
+
+std::size_t PageBuffer::Size() const noexcept {
+    return this->storage != nullptr ? this->storage->Size() : 0;
+}
+
+std::string PageBuffer::ToString() const {
+    std::string res;
+    if (this->storage == nullptr) {
+        return res;
+    }
+    res.reserve(this->storage->Size());
+    for (std::size_t i = 0; i < this->storage->Segments(); i++) {
+        res.append(this->storage->Segment(i));
+    }
+    return res;
+}
+
+bool PageBuffer::Spilled() const noexcept {
+    return this->storage != nullptr && this->storage->Spilled();
+}
+
+void PageBuffer::setSegment(std::size_t index, std::size_t offset) noexcept {
+    this->segment = index;
+    if (this->storage == nullptr || index >= this->storage->Segments()) {
+        this->setg(nullptr, nullptr, nullptr);
+        return;
+    }
+    std::string_view data = this->storage->Segment(index);
+    // The get area is never written through
+    char* start = const_cast<char*>(data.data());
+    this->setg(start, start + offset, start + data.size());
+}
+
+int_type PageBuffer::underflow() {
+    if (this->gptr() < this->egptr()) {
+        return traits_type::to_int_type(*this->gptr());
+    }
+    if (this->storage == nullptr || this->segment + 1 >= this->storage->Segments()) {
+        return traits_type::eof();
+    }
+    this->setSegment(this->segment + 1, 0);
+    return traits_type::to_int_type(*this->gptr());
+}
+
+pos_type PageBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = this->storage != nullptr ? this->segment * this->storage->SegmentSize() + (this->gptr() - this->eback()) : 0;
+    } else if (dir == std::ios_base::end) {
+        base = this->Size();
+    }
+    return this->seekpos(pos_type(base + off), which);
+}
+
+pos_type PageBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+    off_type off = pos;
+    if ((which & std::ios_base::in) == 0 || off < 0 || static_cast<std::size_t>(off) > this->Size()) {
+        return pos_type(off_type(-1));
+    }
+    if (this->storage == nullptr) {
+        return pos;
+    }
+    std::size_t offset = static_cast<std::size_t>(off);
+    std::size_t segmentSize = this->storage->SegmentSize();
+    std::size_t index = segmentSize == 0 ? 0 : offset / segmentSize;
+    // The end of the page is the end of the last segment
+    if (index != 0 && index == this->storage->Segments()) {
+        index--;
+    }
+    this->setSegment(index, offset - index * segmentSize);
+    return pos;
+}
+
+PageTee::PageTee(unsigned pageNumber, const Capt::PageParams& params, std::streambuf& src, PageStore* store)
+    : src(src), storage(std::make_shared<PageBuffer::Storage>(store)), PageNumber(pageNumber), Params(params) {}
+
+PageTee::~PageTee() noexcept = default;
+
+int_type PageTee::underflow() {
+    if (this->page) {
+        return traits_type::eof();
+    }
+    std::string_view data = this->storage->Read(this->src);
+    if (data.empty()) {
+        return traits_type::eof();
+    }
+    // The get area is never written through
+    char* start = const_cast<char*>(data.data());
+    this->setg(start, start, start + data.size());
+    return traits_type::to_int_type(*start);
+}
+
+PageBuffer PageTee::Finish() {
+    if (!this->page) {
+        while (!this->storage->Read(this->src).empty()) {}
+        this->storage->Finish();
+        this->setg(nullptr, nullptr, nullptr);
+        this->page = PageBuffer(this->PageNumber, this->Params, std::move(this->storage));
+    }
+    PageBuffer res = *this->page;
+    res.PageNumber = this->PageNumber;
+    res.Params = this->Params;
+    return res;
+}
+
+PageBuffer EncodePage(Capt::Compression::ScoaStreambuf& ss, unsigned page, const Capt::PageParams& params, std::streambuf& raster, PageStore* store, const PageSink* sink) {
+    ss.Reset(raster, params.ImageLineSize, params.ImageLines);
+    if (sink == nullptr || !*sink) {
+        return PageBuffer(page, params, ss, store);
+    }
+    PageTee tee(page, params, ss, store);
+    (*sink)(tee);
+    return tee.Finish();
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <libcapt/Compression/ScoaStreambuf.hpp>
+#include <libcapt/Protocol/PageParams.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Memory budget and chunk pool for the compressed pages of a job.
+// Chunks of finished pages are recycled for the next ones, pages that do not fit
+// into the budget are kept in unlinked temporary files instead. Thread-safe.
+class PageStore {
+public:
+    static constexpr std::size_t ChunkSize = 64 * 1024;
+    using Chunk = std::unique_ptr<char[]>;
+private:
+    std::size_t budget;
+    std::filesystem::path tmpDir;
+
+    mutable std::mutex mutex;
+    std::vector<Chunk> freeChunks;
+    std::size_t used = 0;
+    std::size_t peak = 0;
+    unsigned allocatedChunks = 0;
+    unsigned spilledPages = 0;
+    std::size_t spilledBytes = 0;
+public:
+    // Empty tmpDir uses the system temporary directory ($TMPDIR)
+    explicit PageStore(std::size_t budget, std::filesystem::path tmpDir = {});
+
+    PageStore(const PageStore&) = delete;
+    PageStore& operator=(const PageStore&) = delete;
+
+    // Allocates chunks for size bytes of pages ahead of time, within the budget
+    void Prefill(std::size_t size);
+
+    // Takes a chunk from the budget, empty if the budget is exhausted
+    [[nodiscard]] Chunk Acquire();
+    void Recycle(Chunk chunk) noexcept;
+
+    // Returns a file descriptor of an anonymous read-write file
+    [[nodiscard]] int CreateTempFile();
+    void Spilled(std::size_t size) noexcept;
+
+    void LogStats() const;
+};
+
+class PageTee;
+
+// Compressed page ready to be sent to the printer, kept in chunks so that it never has to be moved while growing.
+// Copies share the data and have their own read position, so a page can be replayed
+// for reprints and copies. pubseekpos(0) rewinds the page.
+class PageBuffer : public std::streambuf {
+    friend class PageTee;
+private:
+    class Storage;
+    std::shared_ptr<const Storage> storage;
+    std::size_t segment = 0;
+
+    explicit PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::shared_ptr<const Storage> storage) noexcept;
+
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+    void setSegment(std::size_t index, std::size_t offset) noexcept;
+public:
+    unsigned PageNumber = 0;
+    Capt::PageParams Params{};
+
+    PageBuffer() noexcept;
+    // Reads src until the end. Without a store, the page is always kept in memory.
+    explicit PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::streambuf& src, PageStore* store = nullptr);
+    explicit PageBuffer(unsigned pageNumber, const Capt::PageParams& params, std::string_view data, PageStore* store = nullptr);
+    ~PageBuffer() noexcept override;
+
+    PageBuffer(const PageBuffer& other) noexcept;
+    PageBuffer& operator=(const PageBuffer& other) noexcept;
+    PageBuffer(PageBuffer&& other) noexcept;
+    PageBuffer& operator=(PageBuffer&& other) noexcept;
+
+    [[nodiscard]] std::size_t Size() const noexcept;
+    // All of the compressed page regardless of the read position
+    [[nodiscard]] std::string ToString() const;
+    // True if the page is kept in a temporary file
+    [[nodiscard]] bool Spilled() const noexcept;
+};
+
+// Passes the data of src through while keeping it in a PageBuffer,
+// so that a page can be sent while it is being compressed and still be replayed later.
+class PageTee : public std::streambuf {
+private:
+    std::streambuf& src;
+    std::shared_ptr<PageBuffer::Storage> storage;
+    std::optional<PageBuffer> page;
+
+    int_type underflow() override;
+public:
+    unsigned PageNumber;
+    Capt::PageParams Params;
+
+    explicit PageTee(unsigned pageNumber, const Capt::PageParams& params, std::streambuf& src, PageStore* store = nullptr);
+    ~PageTee() noexcept override;
+
+    PageTee(const PageTee&) = delete;
+    PageTee& operator=(const PageTee&) = delete;
+
+    // Reads the rest of src and returns all of the data passed through.
+    // The tee is at the end after that, calling Finish() again returns the same page.
+    PageBuffer Finish();
+};
+
+// Reads the compressed data while it is being produced, e.g. to send the page before it is complete
+using PageSink = std::function<void(PageTee& data)>;
+
+// Compresses exactly params.ImageLineSize x params.ImageLines bytes of raster with ss.
+// If sink is set, it is called with the page first, whatever it leaves unread is compressed afterwards.
+PageBuffer EncodePage(Capt::Compression::ScoaStreambuf& ss, unsigned page, const Capt::PageParams& params, std::streambuf& raster, PageStore* store = nullptr, const PageSink* sink = nullptr);
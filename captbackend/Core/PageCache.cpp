@@ -0,0 +1,278 @@
+#include "PageCache.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cups/cups.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static constexpr char FileMagic[8] = {'C', 'A', 'P', 'T', 'P', 'C', '2', '\0'};
+
+struct FileHeader {
+    char Magic[8];
+    unsigned char Digest[32];
+    uint16_t LineSize;
+    uint16_t Lines;
+    uint32_t Reserved;
+    uint64_t Size;
+
+    bool Matches(const PageCache::Key& key) const noexcept {
+        return std::memcmp(this->Digest, key.Digest->data(), sizeof(this->Digest)) == 0
+            && this->LineSize == key.LineSize && this->Lines == key.Lines;
+    }
+};
+
+static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+
+static inline uint64_t load64(const char* p) noexcept {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t v) noexcept {
+    return std::rotl(acc + v * Prime2, 31) * Prime1;
+}
+
+static inline uint64_t avalanche(uint64_t h) noexcept {
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Four independent lanes in the manner of XXH64, folded into 128 bits
+static void hash128(std::span<const char> data, uint64_t out[2]) noexcept {
+    const char* p = data.data();
+    std::size_t size = data.size();
+    uint64_t v[4] = {Prime1 + Prime2, Prime2, 0, 0 - Prime1};
+    for (; size >= 32; p += 32, size -= 32) {
+        v[0] = round64(v[0], load64(p));
+        v[1] = round64(v[1], load64(p + 8));
+        v[2] = round64(v[2], load64(p + 16));
+        v[3] = round64(v[3], load64(p + 24));
+    }
+    for (unsigned i = 0; size >= 8; p += 8, size -= 8, i++) {
+        v[i] = round64(v[i], load64(p));
+    }
+    if (size != 0) {
+        char tail[8] = {};
+        std::memcpy(tail, p, size);
+        v[3] = round64(v[3], load64(tail) ^ size);
+    }
+    uint64_t len = data.size();
+    out[0] = avalanche(std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18) + len);
+    out[1] = avalanche((v[0] ^ std::rotl(v[2], 29)) * Prime3 + (v[1] ^ std::rotl(v[3], 17)) * Prime1 + len);
+}
+
+std::string PageCache::Key::FileName() const {
+    char name[96];
+    int length = 0;
+    for (unsigned char byte : *this->Digest) {
+        length += std::snprintf(name + length, sizeof(name) - length, "%02x", static_cast<unsigned>(byte));
+    }
+    std::snprintf(name + length, sizeof(name) - length, "-%ux%u",
+        static_cast<unsigned>(this->LineSize), static_cast<unsigned>(this->Lines));
+    return name;
+}
+
+PageCache::PageCache(std::size_t memoryLimit, fs::path dir, std::size_t diskLimit)
+    : memoryLimit(memoryLimit), dir(std::move(dir)), diskLimit(diskLimit) {
+    if (this->dir.empty() || this->diskLimit == 0) {
+        this->dir.clear();
+        return;
+    }
+    std::error_code ec;
+    fs::create_directories(this->dir, ec);
+    if (ec) {
+        Log::Warning() << "Page cache disabled, can't create " << this->dir.string() << ": " << ec.message();
+        this->dir.clear();
+        return;
+    }
+    Log::Debug() << "Page cache: " << (this->memoryLimit / 1024) << " KiB in memory, "
+        << (this->diskLimit / 1024) << " KiB in " << this->dir.string();
+}
+
+PageCache::Key PageCache::MakeKey(std::span<const char> raster, const Capt::PageParams& params) const noexcept {
+    Key key{};
+    hash128(raster, key.Hash);
+    key.LineSize = params.ImageLineSize;
+    key.Lines = params.ImageLines;
+    if (!this->dir.empty()) {
+        std::array<unsigned char, 32> digest;
+        if (cupsHashData("sha2-256", raster.data(), raster.size(), digest.data(), digest.size()) == static_cast<ssize_t>(digest.size())) {
+            key.Digest = digest;
+        } else {
+            Log::Debug() << "cupsHashData failed, page not looked up on disk";
+        }
+    }
+    return key;
+}
+
+PageCache::Data PageCache::Find(const Key& key) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->entries.find(key);
+        if (it != this->entries.end()) {
+            this->lru.splice(this->lru.begin(), this->lru, it->second);
+            this->hits++;
+            return it->second->second;
+        }
+    }
+    Data data = this->findDisk(key);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (data == nullptr) {
+        this->misses++;
+        return nullptr;
+    }
+    this->hits++;
+    this->diskHits++;
+    this->insertMemory(key, data);
+    return data;
+}
+
+void PageCache::Insert(const Key& key, std::string data) {
+    auto shared = std::make_shared<const std::string>(std::move(data));
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->insertMemory(key, shared);
+    }
+    this->insertDisk(key, *shared);
+}
+
+// Requires the mutex
+void PageCache::insertMemory(const Key& key, Data data) {
+    if (data->size() > this->memoryLimit || this->entries.contains(key)) {
+        return;
+    }
+    this->memoryUsed += data->size();
+    this->lru.emplace_front(key, std::move(data));
+    this->entries.emplace(key, this->lru.begin());
+    while (this->memoryUsed > this->memoryLimit) {
+        Entry& last = this->lru.back();
+        this->memoryUsed -= last.second->size();
+        this->entries.erase(last.first);
+        this->lru.pop_back();
+    }
+}
+
+PageCache::Data PageCache::findDisk(const Key& key) {
+    if (this->dir.empty() || !key.Digest) {
+        return nullptr;
+    }
+    fs::path path = this->dir / key.FileName();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    Data data;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(FileHeader)) {
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            FileHeader header;
+            std::memcpy(&header, map, sizeof(header));
+            if (std::memcmp(header.Magic, FileMagic, sizeof(FileMagic)) == 0 && header.Matches(key)
+                && header.Size == size - sizeof(FileHeader)) {
+                data = std::make_shared<const std::string>(static_cast<const char*>(map) + sizeof(FileHeader), header.Size);
+            } else {
+                Log::Debug() << "Ignoring damaged page cache file " << path.string();
+            }
+            munmap(map, size);
+        }
+    }
+    if (data != nullptr) {
+        // Modification time is the LRU order of the disk tier
+        futimens(fd, nullptr);
+    }
+    close(fd);
+    return data;
+}
+
+void PageCache::insertDisk(const Key& key, const std::string& data) {
+    if (this->dir.empty() || !key.Digest || data.size() + sizeof(FileHeader) > this->diskLimit) {
+        return;
+    }
+    fs::path path = this->dir / key.FileName();
+    std::string tmpPath = path.string() + ".XXXXXX";
+    int fd = mkostemp(tmpPath.data(), O_CLOEXEC);
+    if (fd < 0) {
+        Log::Debug() << "Can't create page cache file: " << std::strerror(errno);
+        return;
+    }
+    FileHeader header{};
+    std::memcpy(header.Magic, FileMagic, sizeof(FileMagic));
+    std::memcpy(header.Digest, key.Digest->data(), sizeof(header.Digest));
+    header.LineSize = key.LineSize;
+    header.Lines = key.Lines;
+    header.Size = data.size();
+    bool ok = write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header))
+        && write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    ok = close(fd) == 0 && ok;
+    // Readers see either the complete file or none
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        Log::Debug() << "Can't write page cache file " << path.string();
+        unlink(tmpPath.c_str());
+        return;
+    }
+    this->trimDisk();
+}
+
+void PageCache::trimDisk() {
+    struct File {
+        fs::path Path;
+        fs::file_time_type Time;
+        std::uintmax_t Size;
+    };
+    std::vector<File> files;
+    std::uintmax_t total = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(this->dir, ec)) {
+        std::error_code fileEc;
+        if (!entry.is_regular_file(fileEc)) {
+            continue;
+        }
+        File file{entry.path(), entry.last_write_time(fileEc), entry.file_size(fileEc)};
+        if (fileEc) {
+            continue;
+        }
+        total += file.Size;
+        files.push_back(std::move(file));
+    }
+    if (total <= this->diskLimit) {
+        return;
+    }
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+        return a.Time < b.Time;
+    });
+    for (const File& file : files) {
+        if (total <= this->diskLimit) {
+            break;
+        }
+        if (fs::remove(file.Path, ec)) {
+            total -= file.Size;
+        }
+    }
+}
+
+void PageCache::LogStats() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->hits == 0 && this->misses == 0) {
+        return;
+    }
+    Log::Info() << "Page cache: " << this->hits << " hits (" << this->diskHits << " from disk), "
+        << this->misses << " misses";
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <libcapt/Protocol/PageParams.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+// Compressed pages keyed by the cropped raster they were made from.
+// The memory tier lives for one job, the optional disk tier is shared by all jobs.
+// Thread-safe.
+class PageCache {
+public:
+    using Data = std::shared_ptr<const std::string>;
+
+    struct Key {
+        uint64_t Hash[2];
+        uint16_t LineSize;
+        uint16_t Lines;
+        // SHA-256 of the raster, only with the disk tier: its files are shared by the jobs of all users,
+        // so a page must not be able to collide with another on purpose
+        std::optional<std::array<unsigned char, 32>> Digest;
+
+        bool operator==(const Key& other) const noexcept = default;
+        // Requires Digest
+        std::string FileName() const;
+    };
+private:
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const noexcept {
+            return static_cast<std::size_t>(key.Hash[0]);
+        }
+    };
+    using Entry = std::pair<Key, Data>;
+
+    std::size_t memoryLimit;
+    std::filesystem::path dir;
+    std::size_t diskLimit;
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries;
+    std::size_t memoryUsed = 0;
+    unsigned hits = 0;
+    unsigned diskHits = 0;
+    unsigned misses = 0;
+
+    void insertMemory(const Key& key, Data data);
+    Data findDisk(const Key& key);
+    void insertDisk(const Key& key, const std::string& data);
+    void trimDisk();
+public:
+    // Empty dir or diskLimit == 0 disables the disk tier
+    explicit PageCache(std::size_t memoryLimit, std::filesystem::path dir = {}, std::size_t diskLimit = 0);
+
+    [[nodiscard]] Key MakeKey(std::span<const char> raster, const Capt::PageParams& params) const noexcept;
+
+    // Counts a hit or a miss
+    Data Find(const Key& key);
+    void Insert(const Key& key, std::string data);
+
+    void LogStats() const;
+};
@@ -0,0 +1,177 @@
+#include "PagePipeline.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+using namespace std::literals::chrono_literals;
+
+PagePipeline::PagePipeline(Producer producer, unsigned depth, std::size_t memoryBudget, unsigned threads, EncoderPool* pool)
+    : producer(std::move(producer)), depth(depth), memoryBudget(memoryBudget), pool(pool), logStream(&Log::Stream()) {
+    if (this->depth == 0) {
+        return;
+    }
+    if (this->pool != nullptr) {
+        Log::Debug() << "Page look-ahead: " << this->depth << " pages, " << (this->memoryBudget / 1024)
+            << " KiB, " << this->pool->Threads() << " shared encoder threads";
+        this->reader = std::thread(&PagePipeline::read, this);
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min(threads, this->depth);
+    Log::Debug() << "Page look-ahead: " << this->depth << " pages, " << (this->memoryBudget / 1024)
+        << " KiB, " << threads << " encoder threads";
+    this->reader = std::thread(&PagePipeline::read, this);
+    for (unsigned i = 0; i < threads; i++) {
+        this->encoders.emplace_back(&PagePipeline::encode, this);
+    }
+}
+
+PagePipeline::~PagePipeline() noexcept {
+    this->Stop();
+    if (this->reader.joinable()) {
+        this->reader.join();
+    }
+    for (std::thread& encoder : this->encoders) {
+        encoder.join();
+    }
+    // The pool tasks refer to the pipeline
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cond.wait(lock, [this] { return this->pooled == 0; });
+}
+
+std::size_t PagePipeline::PageMemory(const Capt::PageParams& params) noexcept {
+    // Compressed size is not known in advance, the raster size is an upper estimate
+    return static_cast<std::size_t>(params.ImageLineSize) * params.ImageLines;
+}
+
+void PagePipeline::read() noexcept {
+    Log::SetThreadLogStream(this->logStream);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond.wait(lock, [this] {
+                return this->stopped || this->slots.empty()
+                    || (this->slots.size() < this->depth && this->pagesMemory < this->memoryBudget);
+            });
+            if (this->stopped) {
+                break;
+            }
+        }
+        try {
+            std::optional<Job> job = this->producer();
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!job) {
+                break;
+            }
+            std::size_t memory = PageMemory(job->Params);
+            this->pagesMemory += memory;
+            this->slots.push_back(Slot{memory, std::move(job->Encode), std::nullopt, nullptr});
+            if (this->pool != nullptr) {
+                // Each task compresses whichever page is next, pages of a pipeline may finish out of order
+                this->pool->Submit([this](Capt::Compression::ScoaStreambuf& encoder) {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    if (!this->stopped && this->nextJob < this->slots.size()) {
+                        this->encodeNext(lock, encoder);
+                    }
+                    this->pooled--;
+                    this->cond.notify_all();
+                });
+                this->pooled++;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = std::current_exception();
+            break;
+        }
+        this->cond.notify_all();
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->finished = true;
+    this->cond.notify_all();
+}
+
+void PagePipeline::encode() noexcept {
+    Log::SetThreadLogStream(this->logStream);
+    Capt::Compression::ScoaStreambuf encoder;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->cond.wait(lock, [this] {
+            return this->stopped || this->finished || this->nextJob < this->slots.size();
+        });
+        if (this->stopped || this->nextJob == this->slots.size()) {
+            break;
+        }
+        this->encodeNext(lock, encoder);
+    }
+}
+
+void PagePipeline::encodeNext(std::unique_lock<std::mutex>& lock, Capt::Compression::ScoaStreambuf& encoder) noexcept {
+    // Slots are only popped once encoded, and deque::push_back keeps references valid
+    Slot& slot = this->slots[this->nextJob++];
+    EncodeFunction encode = std::move(slot.Encode);
+    lock.unlock();
+
+    std::optional<Page> page;
+    std::exception_ptr error;
+    try {
+        page.emplace(encode(encoder));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    encode = nullptr;
+
+    lock.lock();
+    slot.Result = std::move(page);
+    slot.Error = error;
+    this->cond.notify_all();
+}
+
+std::optional<PagePipeline::Page> PagePipeline::Next(StopToken stopToken) {
+    if (this->depth == 0) {
+        std::optional<Job> job = this->producer();
+        if (!job) {
+            return std::nullopt;
+        }
+        return job->Encode(this->encoder);
+    }
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto ready = [this] {
+        return this->slots.empty() ? this->finished : (this->slots.front().Result || this->slots.front().Error);
+    };
+    while (!ready()) {
+        if (stopToken.stop_requested()) {
+            return std::nullopt;
+        }
+        // The fallback StopToken has no callbacks, so the wait is bounded
+        this->cond.wait_for(lock, 100ms);
+    }
+    if (this->slots.empty()) {
+        if (this->error) {
+            std::rethrow_exception(std::exchange(this->error, nullptr));
+        }
+        return std::nullopt;
+    }
+    Slot slot = std::move(this->slots.front());
+    this->slots.pop_front();
+    this->nextJob--;
+    this->pagesMemory -= slot.Memory;
+    this->cond.notify_all();
+    if (slot.Error) {
+        std::rethrow_exception(slot.Error);
+    }
+    return std::move(slot.Result);
+}
+
+std::size_t PagePipeline::Pending() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->slots.size();
+}
+
+void PagePipeline::Stop() noexcept {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopped = true;
+    this->cond.notify_all();
+}
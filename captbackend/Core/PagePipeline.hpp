@@ -0,0 +1,79 @@
+#pragma once
+#include "EncoderPool.hpp"
+#include "PageBuffer.hpp"
+#include "StopToken.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Reads pages on a worker thread and compresses them on a pool of encoder threads,
+// keeping up to `depth` pages in flight while the previous one is being printed.
+// Pages are returned in the order they were read.
+class PagePipeline {
+public:
+    using Page = PageBuffer;
+    using EncodeFunction = std::move_only_function<Page(Capt::Compression::ScoaStreambuf&)>;
+    // A page that has been read, but not compressed yet.
+    // Encode may run on any encoder thread, so it must own everything it reads.
+    struct Job {
+        Capt::PageParams Params;
+        EncodeFunction Encode;
+    };
+    using Producer = std::function<std::optional<Job>()>;
+private:
+    struct Slot {
+        std::size_t Memory;
+        EncodeFunction Encode;
+        std::optional<Page> Result;
+        std::exception_ptr Error;
+    };
+
+    Producer producer;
+    unsigned depth;
+    std::size_t memoryBudget;
+    Capt::Compression::ScoaStreambuf encoder;
+    EncoderPool* pool;
+    std::ostream* logStream;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Slot> slots;
+    std::size_t nextJob = 0;
+    std::size_t pagesMemory = 0;
+    std::exception_ptr error;
+    bool finished = false;
+    bool stopped = false;
+    // Tasks submitted to the pool and not finished yet
+    unsigned pooled = 0;
+    std::thread reader;
+    std::vector<std::thread> encoders;
+
+    void read() noexcept;
+    void encode() noexcept;
+    // Compresses the next page, called with the mutex locked
+    void encodeNext(std::unique_lock<std::mutex>& lock, Capt::Compression::ScoaStreambuf& encoder) noexcept;
+public:
+    // depth == 0 reads and compresses synchronously in Next(),
+    // threads == 0 starts one encoder thread per CPU core (never more than depth).
+    // If pool is set, the pages are compressed by it instead of own threads.
+    explicit PagePipeline(Producer producer, unsigned depth, std::size_t memoryBudget, unsigned threads = 1, EncoderPool* pool = nullptr);
+    ~PagePipeline() noexcept;
+
+    PagePipeline(const PagePipeline&) = delete;
+    PagePipeline& operator=(const PagePipeline&) = delete;
+
+    // Rethrows the producer exception after all preceding pages are consumed
+    std::optional<Page> Next(StopToken stopToken);
+    void Stop() noexcept;
+    // Pages read ahead and not returned by Next() yet, so known to exist
+    [[nodiscard]] std::size_t Pending();
+
+    [[nodiscard]] static std::size_t PageMemory(const Capt::PageParams& params) noexcept;
+};
@@ -0,0 +1,46 @@
+#include "PollScheduler.hpp"
+#include <algorithm>
+
+using namespace std::literals::chrono_literals;
+
+PollScheduler::PollScheduler(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval) noexcept
+    : minInterval(minInterval), maxInterval(std::max(minInterval, maxInterval)), interval(minInterval) {}
+
+std::chrono::milliseconds PollScheduler::Limit(const Capt::ExtendedStatus& status) const noexcept {
+    constexpr uint16_t userAction = Capt::EngineReadyStatus::DOOR_OPEN | Capt::EngineReadyStatus::NO_CARTRIDGE
+        | Capt::EngineReadyStatus::NO_PRINT_PAPER | Capt::EngineReadyStatus::JAM | Capt::EngineReadyStatus::SERVICE_CALL;
+    std::chrono::milliseconds limit;
+    if ((status.Engine & userAction) != 0 || status.FatalError()) {
+        // Nothing changes until someone walks up to the printer
+        limit = this->maxInterval;
+    } else if ((status.Engine & Capt::EngineReadyStatus::WAITING) != 0
+        || (status.Basic & (Capt::BasicStatus::CMD_BUSY | Capt::BasicStatus::IM_DATA_BUSY)) != 0) {
+        limit = 100ms;
+    } else if ((status.Basic & Capt::BasicStatus::NOT_READY) != 0) {
+        // Warming up takes seconds
+        limit = 500ms;
+    } else {
+        limit = 250ms;
+    }
+    return std::clamp(limit, this->minInterval, this->maxInterval);
+}
+
+void PollScheduler::Reset() noexcept {
+    this->interval = this->minInterval;
+    this->last.reset();
+}
+
+std::chrono::milliseconds PollScheduler::Next(const Capt::ExtendedStatus& status) noexcept {
+    State state{
+        static_cast<uint8_t>(status.Basic), static_cast<uint8_t>(status.Aux),
+        static_cast<uint16_t>(status.Controller), static_cast<uint16_t>(status.Engine),
+        status.Printing, status.Shipped, status.Printed
+    };
+    if (this->last == state) {
+        this->interval = std::min(this->interval * 2, this->Limit(status));
+    } else {
+        this->interval = this->minInterval;
+        this->last = state;
+    }
+    return this->interval;
+}
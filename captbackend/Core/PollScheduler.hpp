@@ -0,0 +1,37 @@
+#pragma once
+#include <libcapt/Protocol/ExtendedStatus.hpp>
+#include <chrono>
+#include <optional>
+
+// Chooses the interval before the next status poll from the current status.
+// Polls at minInterval after Reset() and whenever the status changes, then backs off
+// up to a limit that depends on the state: short while a command or WAITING is clearing,
+// long while the printer waits for the user. Not thread-safe.
+class PollScheduler {
+private:
+    struct State {
+        uint8_t Basic;
+        uint8_t Aux;
+        uint16_t Controller;
+        uint16_t Engine;
+        uint16_t Printing;
+        uint16_t Shipped;
+        uint16_t Printed;
+
+        bool operator==(const State& other) const noexcept = default;
+    };
+
+    std::chrono::milliseconds minInterval;
+    std::chrono::milliseconds maxInterval;
+    std::chrono::milliseconds interval;
+    std::optional<State> last;
+public:
+    explicit PollScheduler(std::chrono::milliseconds minInterval, std::chrono::milliseconds maxInterval) noexcept;
+
+    // Longest interval for the status, between minInterval and maxInterval
+    [[nodiscard]] std::chrono::milliseconds Limit(const Capt::ExtendedStatus& status) const noexcept;
+
+    // Called after a command, the printer is about to change its state
+    void Reset() noexcept;
+    [[nodiscard]] std::chrono::milliseconds Next(const Capt::ExtendedStatus& status) noexcept;
+};
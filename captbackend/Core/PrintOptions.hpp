@@ -0,0 +1,49 @@
+#pragma once
+#include "Config.hpp"
+#include <cstddef>
+#include <filesystem>
+
+class EncoderPool;
+
+struct PrintOptions {
+    // Copies made by the backend from the compressed pages
+    unsigned Copies = 1;
+    // Print copies as 1,2,3,1,2,3 instead of 1,1,2,2,3,3
+    bool Collate = false;
+    // Memory limit for the compressed pages of the job, the rest is kept in temporary files
+    std::size_t PageMemory = static_cast<std::size_t>(CAPTBACKEND_PAGE_MEMORY_MB) * 1024 * 1024;
+    // Read the raster with the in-tree reader instead of libcups
+    bool NativeRaster = CAPTBACKEND_NATIVE_RASTER;
+    // Number of pages read and compressed ahead of the page being printed (0 - serial)
+    unsigned LookaheadPages = CAPTBACKEND_LOOKAHEAD_PAGES;
+    // Upper bound for the raster size of the look-ahead pages, and of the pages read ahead for the other printers of a pooled job
+    std::size_t LookaheadMemory = static_cast<std::size_t>(CAPTBACKEND_LOOKAHEAD_MEMORY_MB) * 1024 * 1024;
+    // Number of threads compressing look-ahead pages in parallel (0 - one per CPU core)
+    unsigned EncoderThreads = CAPTBACKEND_ENCODER_THREADS;
+    // Threads shared with other jobs that compress the look-ahead pages instead (see EncoderPool)
+    EncoderPool* Encoders = nullptr;
+    // Bulk transfers in flight while writing to the printer (0 - synchronous writes)
+    unsigned UsbTransfers = CAPTBACKEND_USB_TRANSFERS;
+    // Send each page while it is being compressed instead of after it (disables look-ahead)
+    bool StreamPages = false;
+    // Bring the engine online for the next page while it is still being compressed, and for the first one from the start of the job
+    bool PrepareEarly = true;
+    // Print 600 dpi raster at 300 dpi
+    bool Draft = false;
+    // Do not send blank lines at the top and at the bottom of the page
+    bool TrimBlank = true;
+    // Do not print pages without ink at all
+    bool SkipBlankPages = false;
+    // Memory limit for compressed pages reused within the job (0 - no cache)
+    std::size_t PageCacheMemory = static_cast<std::size_t>(CAPTBACKEND_PAGE_CACHE_MEMORY_MB) * 1024 * 1024;
+    // Size limit of the compressed pages kept in PageCacheDir across jobs (0 - disabled).
+    // Build setting only: the files are shared by the jobs of all users.
+    std::size_t PageCacheDisk = static_cast<std::size_t>(CAPTBACKEND_PAGE_CACHE_DISK_MB) * 1024 * 1024;
+    std::filesystem::path PageCacheDir;
+    // Hand the job to the daemon, which keeps the unit reserved for the next job
+    bool Daemon = CAPTBACKEND_DAEMON;
+    // Seconds the daemon keeps the unit reserved after the job, at most the build default
+    unsigned DaemonLinger = CAPTBACKEND_DAEMON_LINGER;
+    // Pages a printer of a pool takes at a time (pools are set up in the daemon, see DaemonConfig)
+    unsigned PoolRangePages = 10;
+};
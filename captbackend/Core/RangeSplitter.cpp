@@ -0,0 +1,202 @@
+#include "RangeSplitter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+RangeSplitter::RangeSplitter(RasterStreambuf& src, unsigned rangePages, std::size_t memoryBudget) noexcept
+    : src(src), rangePages(std::max(rangePages, 1u)), memoryBudget(memoryBudget) {}
+
+RangeSplitter::Reader& RangeSplitter::AddReader() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->readers.push_back(std::unique_ptr<Reader>(new Reader(*this)));
+    return *this->readers.back();
+}
+
+unsigned RangeSplitter::Left() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return static_cast<unsigned>(this->returned.size());
+}
+
+bool RangeSplitter::readPage() {
+    std::optional<Capt::PageParams> params = this->src.NextPage();
+    if (!params) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->eof = true;
+        this->cond.notify_all();
+        return false;
+    }
+    Reader::Page page{this->pagesRead, *params, {}, 0};
+    while (true) {
+        std::span<const char> line = this->src.NextLine();
+        if (line.empty()) {
+            break;
+        }
+        if (page.LineSize == 0) {
+            page.LineSize = line.size();
+            page.Data.reserve(line.size() * params->ImageLines);
+        }
+        page.Data.insert(page.Data.end(), line.begin(), line.end());
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // Pages are only read up to a page that has been taken, so every page has an owner
+    auto owner = std::prev(this->owners.upper_bound(this->pagesRead++));
+    this->queuedMemory += page.Data.size();
+    this->cond.notify_all();
+    if (owner->second->failed) {
+        this->returned.emplace(page.Number, std::move(page));
+    } else {
+        owner->second->queue.push_back(std::move(page));
+    }
+    return true;
+}
+
+bool RangeSplitter::full(const Reader& reader) const {
+    const Reader* owner = std::prev(this->owners.upper_bound(this->pagesRead))->second;
+    // Pages of failed readers are taken by whoever reads them
+    return owner != &reader && !owner->failed && this->queuedMemory != 0 && this->queuedMemory >= this->memoryBudget;
+}
+
+std::vector<RangeSplitter::Range> RangeSplitter::toRanges(std::vector<unsigned> pages) {
+    std::ranges::sort(pages);
+    std::vector<Range> res;
+    for (unsigned page : pages) {
+        if (!res.empty() && res.back().second == page) {
+            res.back().second++;
+        } else {
+            res.emplace_back(page, page + 1);
+        }
+    }
+    return res;
+}
+
+RangeSplitter::Reader::Reader(RangeSplitter& splitter) noexcept : splitter(splitter) {}
+
+std::optional<Capt::PageParams> RangeSplitter::Reader::NextPage() {
+    this->current = nullptr;
+    this->setg(nullptr, nullptr, nullptr);
+    RangeSplitter& s = this->splitter;
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while (true) {
+        // The ranges of the reader first, so that they are printed in order
+        if (!this->queue.empty()) {
+            this->taken.push_back(std::move(this->queue.front()));
+            this->queue.pop_front();
+            this->next++;
+            break;
+        }
+        if (!s.returned.empty()) {
+            this->taken.push_back(std::move(s.returned.begin()->second));
+            s.returned.erase(s.returned.begin());
+            break;
+        }
+        // Every page has been read, the rest of the range is past the end
+        if (s.eof) {
+            return std::nullopt;
+        }
+        if (this->next == this->end) {
+            this->next = s.nextRange;
+            this->end = this->next + s.rangePages;
+            s.nextRange = this->end;
+            s.owners.emplace(this->next, this);
+            continue;
+        }
+        lock.unlock();
+        {
+            // Another reader may be reading the page, it is queued here in that case
+            std::unique_lock<std::mutex> readLock(s.readMutex);
+            lock.lock();
+            if (!this->queue.empty() || !s.returned.empty() || s.eof) {
+                continue;
+            }
+            if (s.full(*this)) {
+                readLock.unlock();
+                // The other readers take their pages, or fail and hand them over
+                s.cond.wait(lock);
+                continue;
+            }
+            lock.unlock();
+            s.readPage();
+        }
+        lock.lock();
+    }
+    this->current = &this->taken.back();
+    s.queuedMemory -= this->current->Data.size();
+    s.cond.notify_all();
+    this->numbers.push_back(this->current->Number);
+    char* data = this->current->Data.data();
+    this->setg(data, data, data + this->current->Data.size());
+    return this->current->Params;
+}
+
+std::span<const char> RangeSplitter::Reader::NextLine() {
+    if (this->current == nullptr || this->gptr() == this->egptr()) {
+        return {};
+    }
+    std::size_t size = std::min<std::size_t>(this->current->LineSize, this->egptr() - this->gptr());
+    std::span<const char> line(this->gptr(), size);
+    this->gbump(static_cast<int>(size));
+    return line;
+}
+
+RangeSplitter::Reader::int_type RangeSplitter::Reader::underflow() {
+    return this->gptr() == this->egptr() ? traits_type::eof() : traits_type::to_int_type(*this->gptr());
+}
+
+unsigned RangeSplitter::Reader::Taken() const {
+    std::lock_guard<std::mutex> lock(this->splitter.mutex);
+    return static_cast<unsigned>(this->numbers.size());
+}
+
+unsigned RangeSplitter::Reader::PageNumber(unsigned index) const {
+    std::lock_guard<std::mutex> lock(this->splitter.mutex);
+    return this->numbers.at(index);
+}
+
+void RangeSplitter::Reader::Starting(unsigned index) {
+    std::lock_guard<std::mutex> lock(this->splitter.mutex);
+    // The page being read stays
+    while (this->sent < index && this->taken.size() > 1) {
+        this->taken.pop_front();
+        this->sent++;
+    }
+}
+
+void RangeSplitter::Reader::Finish() {
+    std::lock_guard<std::mutex> lock(this->splitter.mutex);
+    this->current = nullptr;
+    this->setg(nullptr, nullptr, nullptr);
+    this->taken.clear();
+    this->sent = static_cast<unsigned>(this->numbers.size());
+}
+
+std::vector<RangeSplitter::Range> RangeSplitter::Reader::Fail() {
+    RangeSplitter& s = this->splitter;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    this->current = nullptr;
+    this->setg(nullptr, nullptr, nullptr);
+    this->failed = true;
+    std::vector<unsigned> pages;
+    for (std::deque<Page>* pending : {&this->taken, &this->queue}) {
+        for (Page& page : *pending) {
+            pages.push_back(page.Number);
+            if (pending == &this->taken) {
+                s.queuedMemory += page.Data.size();
+            }
+            s.returned.emplace(page.Number, std::move(page));
+        }
+        pending->clear();
+    }
+    // The pages of the range that have not been read go to the others when they are read
+    unsigned last = s.eof ? std::min(this->end, s.pagesRead) : this->end;
+    for (unsigned page = std::max(this->next, s.pagesRead); page < last; page++) {
+        pages.push_back(page);
+    }
+    this->numbers.resize(this->sent);
+    s.cond.notify_all();
+    return toRanges(std::move(pages));
+}
+
+std::vector<RangeSplitter::Range> RangeSplitter::Reader::Printed() const {
+    std::lock_guard<std::mutex> lock(this->splitter.mutex);
+    return toRanges(std::vector<unsigned>(this->numbers.begin(), this->numbers.begin() + this->sent));
+}
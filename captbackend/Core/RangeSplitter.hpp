@@ -0,0 +1,110 @@
+#pragma once
+#include "RasterStreambuf.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Splits the pages of one raster into contiguous ranges for printers sharing a job.
+// A reader takes the next range of rangePages pages once it has read its own,
+// so faster printers print more ranges. Pages read on behalf of another reader
+// are kept in memory until it takes them, reading for the others waits while they
+// take more than memoryBudget. The pages a failed reader has not sent
+// go to the other readers (see Reader::Fail()). Thread-safe.
+class RangeSplitter {
+public:
+    // First page and one past the last page (zero-based)
+    using Range = std::pair<unsigned, unsigned>;
+
+    class Reader : public RasterStreambuf {
+    private:
+        friend class RangeSplitter;
+
+        struct Page {
+            // Zero-based page number in the job
+            unsigned Number;
+            Capt::PageParams Params;
+            std::vector<char> Data;
+            std::size_t LineSize;
+        };
+
+        RangeSplitter& splitter;
+        // Pages of the ranges of the reader, not taken yet
+        std::deque<Page> queue;
+        // Pages handed out and not sent yet, kept for Fail(). The last one is being read.
+        std::deque<Page> taken;
+        // Pages handed out, in order
+        std::vector<unsigned> numbers;
+        // Number of pages sent
+        unsigned sent = 0;
+        unsigned next = 0;
+        unsigned end = 0;
+        bool failed = false;
+        Page* current = nullptr;
+
+        explicit Reader(RangeSplitter& splitter) noexcept;
+
+        int_type underflow() override;
+    public:
+        std::optional<Capt::PageParams> NextPage() override;
+        std::span<const char> NextLine() override;
+
+        // Number of pages handed out by NextPage()
+        [[nodiscard]] unsigned Taken() const;
+        // Page number in the job of the index-th page handed out (zero-based)
+        [[nodiscard]] unsigned PageNumber(unsigned index) const;
+
+        // The printer starts the index-th page handed out, so the ones before it have been sent
+        void Starting(unsigned index);
+        // The printer has printed every page handed out
+        void Finish();
+        // The printer failed, the pages it has not sent are read by the other readers.
+        // The reader must not be used anymore. Returns the pages handed over.
+        std::vector<Range> Fail();
+
+        // Pages sent so far
+        [[nodiscard]] std::vector<Range> Printed() const;
+    };
+private:
+    RasterStreambuf& src;
+    unsigned rangePages;
+    std::size_t memoryBudget;
+
+    // Serializes reading from src, taken before mutex
+    std::mutex readMutex;
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<std::unique_ptr<Reader>> readers;
+    // Readers by the first page of their ranges
+    std::map<unsigned, Reader*> owners;
+    // Pages of failed readers by their numbers
+    std::map<unsigned, Reader::Page> returned;
+    unsigned nextRange = 0;
+    unsigned pagesRead = 0;
+    bool eof = false;
+    // Raster size of the queued and returned pages
+    std::size_t queuedMemory = 0;
+
+    // Reads the next page of src and queues it for its reader, returns false at the end
+    bool readPage();
+    // The next page of src is for another reader and there is no room for it
+    [[nodiscard]] bool full(const Reader& reader) const;
+    // Contiguous ranges of the sorted page numbers
+    static std::vector<Range> toRanges(std::vector<unsigned> pages);
+public:
+    explicit RangeSplitter(RasterStreambuf& src, unsigned rangePages, std::size_t memoryBudget) noexcept;
+
+    RangeSplitter(const RangeSplitter&) = delete;
+    RangeSplitter& operator=(const RangeSplitter&) = delete;
+
+    // The reader lives as long as the splitter
+    [[nodiscard]] Reader& AddReader();
+    // Pages handed over by failed readers that no reader has taken, e.g. because
+    // the others had finished already. Reading again takes them.
+    [[nodiscard]] unsigned Left() const;
+};
@@ -0,0 +1,98 @@
+#include "RasterPage.hpp"
+#include "BlankLine.hpp"
+#include "Downsample.hpp"
+#include "Log.hpp"
+#include "RasterError.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <libcapt/Utility/Crop.hpp>
+
+void RasterPage::Load(RasterStreambuf& src, std::size_t lineSize, unsigned lines) {
+    this->lineSize = lineSize;
+    this->lines = lines;
+    this->data.resize(lineSize * lines);
+    for (unsigned y = 0; y < lines; y++) {
+        std::span<const char> line = src.NextLine();
+        if (line.size() < lineSize) {
+            throw RasterError("unexpected end of page");
+        }
+        std::memcpy(this->data.data() + y * lineSize, line.data(), lineSize);
+    }
+    while (!src.NextLine().empty()) {}
+    this->SetWindow(0, lines);
+}
+
+std::pair<unsigned, unsigned> RasterPage::BlankBands() const noexcept {
+    unsigned top = 0;
+    while (top < this->lines && IsBlankLine(this->Line(top))) {
+        top++;
+    }
+    if (top == this->lines) {
+        return {top, 0};
+    }
+    unsigned bottom = 0;
+    while (IsBlankLine(this->Line(this->lines - bottom - 1))) {
+        bottom++;
+    }
+    return {top, bottom};
+}
+
+void RasterPage::SetWindow(unsigned first, unsigned count) noexcept {
+    assert(first + count <= this->lines);
+    char* start = this->data.data() + first * this->lineSize;
+    this->setg(start, start, start + count * this->lineSize);
+}
+
+void RasterPage::Downsample() noexcept {
+    std::size_t outSize = (this->lineSize + 1) / 2;
+    unsigned outLines = (this->lines + 1) / 2;
+    for (unsigned y = 0; y < outLines; y++) {
+        char* first = this->data.data() + 2 * y * this->lineSize;
+        // The last line of an odd page has no pair
+        const char* second = 2 * y + 1 < this->lines ? first + this->lineSize : first;
+        OrLines(first, second, first, this->lineSize);
+        HalveLine(first, this->data.data() + y * outSize, this->lineSize);
+    }
+    this->lineSize = outSize;
+    this->lines = outLines;
+    this->SetWindow(0, outLines);
+}
+
+void RasterPage::Downsample(Capt::PageParams& params) noexcept {
+    this->Downsample();
+    params.Resolution = Capt::ResolutionIdx::RES_300;
+    params.ImageLineSize = static_cast<uint16_t>(this->lineSize);
+    params.ImageLines = static_cast<uint16_t>(this->lines);
+    params.MarginLeft /= 2;
+    // Margins are in dots of the page resolution. MakePageParams() never sends a top margin of 0,
+    // which halving a margin of 1 would give.
+    params.MarginTop = std::max<uint16_t>(params.MarginTop / 2, 1);
+}
+
+void CropPageParams(Capt::PageParams& params) noexcept {
+    // PaperWidth and PaperHeight are 600 dpi dots at both resolutions (see ppd/genmedia.py),
+    // a 300 dpi raster covers the paper with half as many
+    uint16_t scale = params.Resolution == Capt::ResolutionIdx::RES_300 ? 2 : 1;
+    uint16_t lineSize = Capt::Utility::CropLineSize(params.ImageLineSize, params.PaperWidth / scale);
+    uint16_t lines = Capt::Utility::CropLinesCount(params.ImageLines, params.PaperHeight / scale);
+    Log::Debug() << "Cropping raster from " << params.ImageLineSize << 'x' << params.ImageLines
+        << " to " << lineSize << 'x' << lines;
+    params.ImageLineSize = lineSize;
+    params.ImageLines = lines;
+}
+
+std::unique_ptr<RasterPage> RasterPagePool::Acquire() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->pages.empty()) {
+        return std::make_unique<RasterPage>();
+    }
+    std::unique_ptr<RasterPage> page = std::move(this->pages.back());
+    this->pages.pop_back();
+    return page;
+}
+
+void RasterPagePool::Release(std::unique_ptr<RasterPage> page) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->pages.push_back(std::move(page));
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "RasterStreambuf.hpp"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+// A cropped page held in memory, so that it can be inspected before compression.
+// The get area covers the lines selected by SetWindow() (the whole page after Load()).
+class RasterPage : public std::streambuf {
+private:
+    std::vector<char> data;
+    std::size_t lineSize = 0;
+    unsigned lines = 0;
+public:
+    // Reads lineSize x lines from the current page of src and skips the rest of it
+    void Load(RasterStreambuf& src, std::size_t lineSize, unsigned lines);
+
+    std::size_t LineSize() const noexcept {
+        return this->lineSize;
+    }
+    unsigned Lines() const noexcept {
+        return this->lines;
+    }
+    std::span<const char> Line(unsigned y) const noexcept {
+        return {this->data.data() + y * this->lineSize, this->lineSize};
+    }
+
+    // Lines selected by SetWindow()
+    std::span<const char> Window() const noexcept {
+        return {this->eback(), this->egptr()};
+    }
+
+    // Number of blank lines at the top and at the bottom of the page.
+    // For a blank page top is equal to Lines() and bottom is 0.
+    std::pair<unsigned, unsigned> BlankBands() const noexcept;
+    void SetWindow(unsigned first, unsigned count) noexcept;
+
+    // Halves the resolution in place (see Downsample.hpp), selects the whole page
+    void Downsample() noexcept;
+    // Same, and turns the 600 dpi params of the page into 300 dpi ones
+    void Downsample(Capt::PageParams& params) noexcept;
+};
+
+// Crops the raster size in params to the paper size
+void CropPageParams(Capt::PageParams& params) noexcept;
+
+// Free list of pages, so that the page memory is reused from one page to the next. Thread-safe.
+class RasterPagePool {
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<RasterPage>> pages;
+public:
+    std::unique_ptr<RasterPage> Acquire();
+    void Release(std::unique_ptr<RasterPage> page);
+};
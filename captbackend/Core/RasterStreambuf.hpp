@@ -1,10 +1,17 @@
 #pragma once
 #include <streambuf>
 #include <optional>
+#include <span>
 #include <libcapt/Protocol/PageParams.hpp>
 
+// The streambuf interface is kept for byte-oriented consumers,
+// it must not be mixed with NextLine() within a page.
 class RasterStreambuf : public virtual std::streambuf {
 public:
     virtual ~RasterStreambuf() noexcept = default;
     virtual std::optional<Capt::PageParams> NextPage() = 0;
+
+    // Next line of the current page, empty after the last one.
+    // Points into the reader's buffer and stays valid until the next call.
+    virtual std::span<const char> NextLine() = 0;
 };
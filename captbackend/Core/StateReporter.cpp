@@ -1,7 +1,9 @@
 #include "StateReporter.hpp"
+#include "Log.hpp"
 #include <algorithm>
 #include <cassert>
 #include <string_view>
+#include <utility>
 
 using namespace Capt;
 
@@ -9,11 +11,15 @@ StateReporter::StateReporter(std::ostream& stream) noexcept : stream(stream) {
     assert(stream.exceptions() == std::ios_base::goodbit);
 }
 
+StateReporter::StateReporter(StateReporter& job, PageMap pageMap) noexcept
+    : stream(job.stream), job(&job), pageMap(std::move(pageMap)) {}
+
 StateReporter::~StateReporter() noexcept {
     this->Clear();
 }
 
 void StateReporter::Update(ExtendedStatus status) {
+    auto lock = Log::Lock();
     bool serviceCall = status.ServiceCall();
     bool fatal = status.FatalError();
     if (serviceCall || fatal) {
@@ -38,11 +44,16 @@ void StateReporter::Update(ExtendedStatus status) {
 }
 
 void StateReporter::SetReason(std::string_view reason, bool set) {
+    auto lock = Log::Lock();
     bool contains = std::ranges::find(this->reasons.cbegin(), this->reasons.cend(), reason) != this->reasons.cend();
     if (set == contains) {
         return;
     }
-    this->stream << "STATE: " << (set ? '+' : '-') << reason << std::endl;
+    if (this->job != nullptr) {
+        this->job->share(reason, set);
+    } else {
+        this->stream << "STATE: " << (set ? '+' : '-') << reason << std::endl;
+    }
     if (set) {
         this->reasons.insert(reason);
     } else {
@@ -50,13 +61,34 @@ void StateReporter::SetReason(std::string_view reason, bool set) {
     }
 }
 
+void StateReporter::share(std::string_view reason, bool set) {
+    unsigned& count = this->shared[reason];
+    count += set ? 1 : -1;
+    if (count == (set ? 1 : 0)) {
+        this->SetReason(reason, set);
+    }
+    if (count == 0) {
+        this->shared.erase(reason);
+    }
+}
+
 void StateReporter::Clear() noexcept {
+    auto lock = Log::Lock();
     for (const std::string_view s : this->reasons) {
-        this->stream << "STATE: -" << s << std::endl;
+        if (this->job != nullptr) {
+            this->job->share(s, false);
+        } else {
+            this->stream << "STATE: -" << s << std::endl;
+        }
     }
     this->reasons.clear();
 }
 
 void StateReporter::Page(unsigned page) noexcept {
+    auto lock = Log::Lock();
+    if (this->job != nullptr) {
+        this->job->Page(this->pageMap(page));
+        return;
+    }
     this->stream << "PAGE: page-number " << page << std::endl;
 }
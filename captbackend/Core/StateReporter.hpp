@@ -1,18 +1,37 @@
 #pragma once
 #include <ostream>
 #include <libcapt/Protocol/ExtendedStatus.hpp>
+#include <functional>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 
+// Thread-safe, messages are serialized with the log (see Log::Lock())
 class StateReporter {
+public:
+    // Maps a page number of one printer to the page number of the job
+    using PageMap = std::function<unsigned(unsigned page)>;
 private:
     std::ostream& stream;
+    // Set for a printer sharing the job of the reporter (see PageMap)
+    StateReporter* job = nullptr;
+    PageMap pageMap;
     std::unordered_set<std::string_view> reasons;
+    // Number of printers reporting each reason, on the reporter of a shared job
+    std::unordered_map<std::string_view, unsigned> shared;
+
+    void share(std::string_view reason, bool set);
 public:
     // stream MUST be noexcept
     explicit StateReporter(std::ostream& stream) noexcept;
+    // Reports for one of the printers sharing a job through the reporter of the job:
+    // a reason stays set while any printer reports it
+    explicit StateReporter(StateReporter& job, PageMap pageMap) noexcept;
     ~StateReporter() noexcept;
 
+    StateReporter(const StateReporter&) = delete;
+    StateReporter& operator=(const StateReporter&) = delete;
+
     void Update(Capt::ExtendedStatus status);
     void SetReason(std::string_view reason, bool set);
     void Clear() noexcept;
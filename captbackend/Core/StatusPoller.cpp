@@ -0,0 +1,119 @@
+#include "StatusPoller.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <utility>
+
+using namespace std::literals::chrono_literals;
+
+StatusPoller::StatusPoller(PollFunction poll, PollScheduler scheduler, std::chrono::milliseconds slowInterval) noexcept
+    : poll(std::move(poll)), scheduler(scheduler), slowInterval(slowInterval) {}
+
+StatusPoller::StatusPoller(PollFunction poll, std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval) noexcept
+    : StatusPoller(std::move(poll), PollScheduler(fastInterval, fastInterval), slowInterval) {}
+
+StatusPoller::~StatusPoller() noexcept {
+    this->Stop();
+}
+
+void StatusPoller::Start() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->thread.joinable()) {
+        return;
+    }
+    this->stopped = false;
+    this->error = nullptr;
+    this->logStream = &Log::Stream();
+    this->thread = std::thread(&StatusPoller::run, this);
+}
+
+void StatusPoller::Stop() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->cond.notify_all();
+    if (this->thread.joinable()) {
+        this->thread.join();
+    }
+}
+
+void StatusPoller::run() noexcept {
+    Log::SetThreadLogStream(this->logStream);
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        bool fast = this->waiters != 0;
+        std::chrono::milliseconds interval = this->slowInterval;
+        if (fast) {
+            std::shared_ptr<const Snapshot> snapshot = this->latest.load();
+            interval = this->scheduler.Next(snapshot ? snapshot->Status : Capt::ExtendedStatus{});
+        }
+        this->kicked = false;
+        // Restarts the wait with the other interval when the first waiter comes or the last one leaves,
+        // or with the shortest one after a command
+        bool woken = this->cond.wait_for(lock, interval, [this, fast] {
+            return this->stopped || this->wanted > this->sequence || (this->waiters != 0) != fast || this->kicked;
+        });
+        if (woken && !this->stopped && this->wanted <= this->sequence) {
+            continue;
+        }
+        if (this->stopped) {
+            break;
+        }
+        lock.unlock();
+        try {
+            this->poll();
+        } catch (...) {
+            lock.lock();
+            this->error = std::current_exception();
+            this->cond.notify_all();
+            break;
+        }
+        lock.lock();
+    }
+}
+
+void StatusPoller::Publish(const Capt::ExtendedStatus& status) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        unsigned long seq = ++this->sequence;
+        this->latest.store(std::make_shared<const Snapshot>(Snapshot{status, seq}));
+    }
+    this->cond.notify_all();
+}
+
+void StatusPoller::Kick() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->scheduler.Reset();
+        this->kicked = true;
+    }
+    this->cond.notify_all();
+}
+
+std::shared_ptr<const StatusPoller::Snapshot> StatusPoller::Wait(StopToken stopToken, const Predicate& pred, std::chrono::milliseconds timeout, unsigned long after) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->waiters++;
+    this->wanted = std::max(this->wanted, after);
+    // Wakes the poller up, so that it switches to the fast interval
+    this->cond.notify_all();
+    std::shared_ptr<const Snapshot> snapshot;
+    while (true) {
+        if (this->error) {
+            this->waiters--;
+            std::rethrow_exception(this->error);
+        }
+        snapshot = this->latest.load();
+        if (snapshot && snapshot->Sequence >= after && pred(snapshot->Status)) {
+            break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (this->stopped || stopToken.stop_requested() || now >= deadline) {
+            break;
+        }
+        // The fallback StopToken has no callbacks, so the wait is bounded
+        this->cond.wait_until(lock, std::min(deadline, now + 100ms));
+    }
+    this->waiters--;
+    return snapshot;
+}
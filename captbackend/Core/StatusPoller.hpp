@@ -0,0 +1,74 @@
+#pragma once
+#include "PollScheduler.hpp"
+#include "StopToken.hpp"
+#include <libcapt/Protocol/ExtendedStatus.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Polls the printer status on a background thread and keeps the latest one.
+// The poll function must read the status and hand it to Publish().
+// While someone is waiting the scheduler chooses the interval, otherwise it is slowInterval.
+class StatusPoller {
+public:
+    using PollFunction = std::function<void()>;
+    using Predicate = std::function<bool(const Capt::ExtendedStatus& status)>;
+
+    struct Snapshot {
+        Capt::ExtendedStatus Status;
+        // Increases with every published status
+        unsigned long Sequence;
+    };
+private:
+    PollFunction poll;
+    PollScheduler scheduler;
+    std::chrono::milliseconds slowInterval;
+
+    // Readers never take the mutex
+    std::atomic<std::shared_ptr<const Snapshot>> latest;
+    std::atomic<unsigned long> sequence = 0;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned waiters = 0;
+    unsigned long wanted = 0;
+    bool kicked = false;
+    bool stopped = false;
+    std::exception_ptr error;
+    std::ostream* logStream = nullptr;
+    std::thread thread;
+
+    void run() noexcept;
+public:
+    explicit StatusPoller(PollFunction poll, PollScheduler scheduler, std::chrono::milliseconds slowInterval) noexcept;
+    // Polls every fastInterval while someone is waiting
+    explicit StatusPoller(PollFunction poll, std::chrono::milliseconds fastInterval, std::chrono::milliseconds slowInterval) noexcept;
+    ~StatusPoller() noexcept;
+
+    StatusPoller(const StatusPoller&) = delete;
+    StatusPoller& operator=(const StatusPoller&) = delete;
+
+    void Start();
+    void Stop() noexcept;
+
+    void Publish(const Capt::ExtendedStatus& status);
+    // A command has been sent, restarts the schedule from its shortest interval
+    void Kick();
+    // Sequence number of the next published status
+    [[nodiscard]] unsigned long NextSequence() const noexcept {
+        return this->sequence.load() + 1;
+    }
+    [[nodiscard]] std::shared_ptr<const Snapshot> Latest() const noexcept {
+        return this->latest.load();
+    }
+
+    // Waits for a status with Sequence >= after that satisfies pred, at most for timeout.
+    // Returns the latest status in any case (nullptr if there is none yet), rethrows poll errors.
+    std::shared_ptr<const Snapshot> Wait(StopToken stopToken, const Predicate& pred, std::chrono::milliseconds timeout, unsigned long after = 0);
+};
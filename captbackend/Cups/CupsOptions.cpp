@@ -0,0 +1,122 @@
+#include "CupsOptions.hpp"
+#include "Core/Log.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cups/cups.h>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <strings.h>
+#include <thread>
+
+// Upper bounds for the values a job may ask for, any user who can print sets the options
+static constexpr unsigned MaxLookaheadPages = 32;
+static constexpr std::size_t MaxMegabytes = 1024;
+// Each transfer has a buffer of its own (see UsbStreambuf)
+static constexpr unsigned MaxUsbTransfers = 16;
+
+static void getBool(int count, cups_option_t* options, const char* name, bool& value) {
+    const char* str = cupsGetOption(name, count, options);
+    if (str == nullptr) {
+        return;
+    }
+    // PPD choices are capitalized (Collate=True)
+    auto is = [str](const char* v) {
+        return strcasecmp(str, v) == 0;
+    };
+    if (is("true") || is("yes") || is("on") || is("1")) {
+        value = true;
+    } else if (is("false") || is("no") || is("off") || is("0")) {
+        value = false;
+    } else {
+        Log::Warning() << "Ignoring invalid option value " << name << '=' << str;
+    }
+}
+
+template<typename T>
+static bool parseNumber(const char* str, T& value) {
+    T res;
+    const char* end = str + std::strlen(str);
+    auto [ptr, ec] = std::from_chars(str, end, res);
+    if (ec != std::errc() || ptr != end) {
+        return false;
+    }
+    value = res;
+    return true;
+}
+
+template<typename T>
+static void getNumber(int count, cups_option_t* options, const char* name, T& value, T max = std::numeric_limits<T>::max()) {
+    const char* str = cupsGetOption(name, count, options);
+    if (str == nullptr) {
+        return;
+    }
+    T res;
+    if (!parseNumber(str, res)) {
+        Log::Warning() << "Ignoring invalid option value " << name << '=' << str;
+        return;
+    }
+    if (res > max) {
+        Log::Warning() << "Limiting option " << name << '=' << str << " to " << max;
+        res = max;
+    }
+    value = res;
+}
+
+// The option is in MiB, the value in bytes
+static void getMegabytes(int count, cups_option_t* options, const char* name, std::size_t& value) {
+    const char* str = cupsGetOption(name, count, options);
+    std::size_t mb;
+    if (str == nullptr) {
+        return;
+    }
+    if (!parseNumber(str, mb) || mb > std::numeric_limits<std::size_t>::max() / (1024 * 1024)) {
+        Log::Warning() << "Ignoring invalid option value " << name << '=' << str;
+        return;
+    }
+    if (mb > MaxMegabytes) {
+        Log::Warning() << "Limiting option " << name << '=' << str << " to " << MaxMegabytes;
+        mb = MaxMegabytes;
+    }
+    value = mb * 1024 * 1024;
+}
+
+PrintOptions ParsePrintOptions(const char* copies, const char* options) {
+    PrintOptions res;
+    if (copies != nullptr && (!parseNumber(copies, res.Copies) || res.Copies == 0)) {
+        Log::Warning() << "Ignoring invalid number of copies " << copies;
+        res.Copies = 1;
+    }
+    if (options == nullptr) {
+        return res;
+    }
+    cups_option_t* opts = nullptr;
+    int count = cupsParseOptions(options, 0, &opts);
+
+    getBool(count, opts, "collate", res.Collate);
+    const char* handling = cupsGetOption("multiple-document-handling", count, opts);
+    if (handling != nullptr) {
+        res.Collate = std::string_view(handling) != "separate-documents-uncollated-copies";
+    }
+
+    getBool(count, opts, "draftMode", res.Draft);
+    getBool(count, opts, "capt-native-raster", res.NativeRaster);
+    getNumber(count, opts, "capt-lookahead-pages", res.LookaheadPages, MaxLookaheadPages);
+    getMegabytes(count, opts, "capt-lookahead-memory", res.LookaheadMemory);
+    // More threads than cores do not compress any faster
+    getNumber(count, opts, "capt-encoder-threads", res.EncoderThreads, std::max(std::thread::hardware_concurrency(), 1u));
+    getBool(count, opts, "capt-stream-pages", res.StreamPages);
+    getBool(count, opts, "capt-prepare-early", res.PrepareEarly);
+    getNumber(count, opts, "capt-usb-transfers", res.UsbTransfers, MaxUsbTransfers);
+    getBool(count, opts, "capt-trim-blank", res.TrimBlank);
+    getBool(count, opts, "capt-skip-blank", res.SkipBlankPages);
+    getMegabytes(count, opts, "capt-page-memory", res.PageMemory);
+    getMegabytes(count, opts, "capt-page-cache-memory", res.PageCacheMemory);
+    getBool(count, opts, "capt-daemon", res.Daemon);
+    // The unit stays claimed while the daemon lingers
+    getNumber(count, opts, "capt-daemon-linger", res.DaemonLinger, static_cast<unsigned>(CAPTBACKEND_DAEMON_LINGER));
+    getNumber(count, opts, "capt-pool-range", res.PoolRangePages);
+
+    cupsFreeOptions(count, opts);
+    return res;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "Core/PrintOptions.hpp"
+
+// Applies the copies (argv[4]) and backend options (argv[5]) of the job on top of the build defaults
+[[nodiscard]] PrintOptions ParsePrintOptions(const char* copies, const char* options);
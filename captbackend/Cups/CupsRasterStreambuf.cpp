@@ -1,52 +1,103 @@
 #include "CupsRasterStreambuf.hpp"
+#include "RasterHeader.hpp"
 #include "Core/Log.hpp"
 #include "Core/RasterError.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstring>
 #include <unistd.h>
 #include <fcntl.h>
-#include <libcapt/Protocol/Enums.hpp>
 
 using int_type = CupsRasterStreambuf::int_type;
 
-int_type CupsRasterStreambuf::underflow() {
+CupsRasterStreambuf::CupsRasterStreambuf(std::size_t stripSize) noexcept : stripSize(stripSize) {}
+
+std::size_t CupsRasterStreambuf::readLines(char_type* dest, std::size_t lines) {
     assert(this->raster != nullptr);
+    assert(lines != 0 && lines <= this->linesRemain);
+    std::size_t count = lines * this->lineSize;
+    std::size_t read = cupsRasterReadPixels(this->raster, reinterpret_cast<unsigned char*>(dest), count);
+    if (read != count) {
+        Log::Debug() << "cupsRasterReadPixels returned " << read
+            << ", requested " << count
+            << ", linesRemain=" << this->linesRemain;
+        throw RasterError("unexpected EOF");
+    }
+    this->linesRemain -= lines;
+    return count;
+}
+
+int_type CupsRasterStreambuf::underflow() {
     if (this->gptr() < this->egptr()) {
         return traits_type::to_int_type(*this->gptr());
     }
     if (this->linesRemain == 0) {
         return traits_type::eof();
     }
-    std::size_t read = cupsRasterReadPixels(this->raster, reinterpret_cast<unsigned char*>(this->lineBuffer.data()), this->lineBuffer.size());
-    if (read != this->lineBuffer.size()) {
-        Log::Debug() << "cupsRasterReadPixels returned " << read
-            << ", requested " << this->lineBuffer.size()
-            << ", linesRemain=" << this->linesRemain;
-        throw RasterError("unexpected EOF");
-    }
-    this->linesRemain--;
-    char_type* start = this->lineBuffer.data();
-    char_type* end = start + read;
-    this->setg(start, start, end);
+    std::size_t lines = std::min<std::size_t>(this->stripBuffer.size() / this->lineSize, this->linesRemain);
+    char_type* start = this->stripBuffer.data();
+    std::size_t read = this->readLines(start, lines);
+    this->setg(start, start, start + read);
     return traits_type::to_int_type(*this->gptr());
 }
 
+std::streamsize CupsRasterStreambuf::xsgetn(char_type* s, std::streamsize count) {
+    std::streamsize total = 0;
+    while (total < count) {
+        std::streamsize avail = this->egptr() - this->gptr();
+        if (avail > 0) {
+            std::streamsize n = std::min(avail, count - total);
+            std::copy_n(this->gptr(), n, s + total);
+            this->gbump(static_cast<int>(n));
+            total += n;
+            continue;
+        }
+        if (this->linesRemain == 0) {
+            break;
+        }
+        // Whole lines go straight to the caller, bypassing the strip buffer
+        std::size_t lines = std::min<std::size_t>((count - total) / this->lineSize, this->linesRemain);
+        if (lines != 0) {
+            total += this->readLines(s + total, lines);
+        } else if (traits_type::eq_int_type(this->underflow(), traits_type::eof())) {
+            break;
+        }
+    }
+    return total;
+}
+
+std::span<const char> CupsRasterStreambuf::NextLine() {
+    if (this->gptr() == this->egptr()) {
+        if (traits_type::eq_int_type(this->underflow(), traits_type::eof())) {
+            return {};
+        }
+    }
+    assert(static_cast<std::size_t>(this->egptr() - this->gptr()) >= this->lineSize);
+    std::span<const char> line(this->gptr(), this->lineSize);
+    this->gbump(static_cast<int>(this->lineSize));
+    return line;
+}
+
 CupsRasterStreambuf::~CupsRasterStreambuf() noexcept {
     this->Close();
 }
 
 bool CupsRasterStreambuf::Open(const char* file) noexcept {
-    assert(this->raster == nullptr);
     if (file == nullptr) {
-        this->fd = STDIN_FILENO;
-    } else {
-        this->fd = open(file, O_RDONLY);
-        if (this->fd < 0) {
-            Log::Debug() << "open() failed: " << strerror(errno);
-            return false;
-        }
+        return this->Open(STDIN_FILENO);
+    }
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        Log::Debug() << "open() failed: " << strerror(errno);
+        return false;
     }
+    return this->Open(fd);
+}
+
+bool CupsRasterStreambuf::Open(int fd) noexcept {
+    assert(this->raster == nullptr);
+    this->fd = fd;
     this->raster = cupsRasterOpen(this->fd, CUPS_RASTER_READ);
     return this->raster != nullptr;
 }
@@ -68,38 +119,11 @@ std::optional<Capt::PageParams> CupsRasterStreambuf::NextPage() {
         Log::Debug() << "No more pages";
         return std::nullopt;
     }
-    if (header.cupsBitsPerPixel != 1 || header.cupsBitsPerColor != 1 || header.cupsNumColors != 1) {
-        Log::Debug() << "Invalid raster format: cupsBitsPerPixel=" << header.cupsBitsPerPixel
-            << " cupsBitsPerColor=" << header.cupsBitsPerColor
-            << " cupsNumColors=" << header.cupsNumColors;
-        throw RasterError("invalid raster format");
-    }
-    Log::Debug() << "Read header " << header.cupsBytesPerLine << 'x' << header.cupsHeight << " (" << header.cupsPageSizeName << ')';
-    // Margins:
-    //   left  : cupsImagingBBox[0]
-    //   bottom: cupsImagingBBox[1]
-    //   right : cupsPageSize[0] - cupsImagingBBox[2]
-    //   top   : cupsPageSize[1] - cupsImagingBBox[3]
-    uint16_t marginLeft = header.cupsImagingBBox[0] / 72.0f * header.HWResolution[0];
-    uint16_t marginTop = (header.cupsPageSize[1] - header.cupsImagingBBox[3]) / 72.0f * header.HWResolution[0];
-    if (marginTop == 0) {
-        marginTop = 1;
-    }
-    Log::Debug() << "Page margins: left=" << marginLeft << " top=" << marginTop;
+    Capt::PageParams params = MakePageParams(header);
     this->linesRemain = header.cupsHeight;
-    this->lineBuffer.resize(header.cupsBytesPerLine);
-    return Capt::PageParams{
-        .PaperSize = static_cast<uint8_t>(header.cupsInteger[2]),
-        .TonerDensity = static_cast<uint8_t>(header.cupsCompression),
-        .Mode = static_cast<uint8_t>(header.cupsMediaType),
-        .Resolution = header.HWResolution[0] == 600 ? Capt::ResolutionIdx::RES_600 : Capt::ResolutionIdx::RES_300,
-        .SmoothEnable = header.cupsInteger[5] != 0,
-        .TonerSaving = header.cupsInteger[6] != 0,
-        .MarginLeft = marginLeft,
-        .MarginTop = marginTop,
-        .ImageLineSize = static_cast<uint16_t>(header.cupsBytesPerLine),
-        .ImageLines = static_cast<uint16_t>(header.cupsHeight),
-        .PaperWidth = static_cast<uint16_t>(header.cupsInteger[0]),
-        .PaperHeight = static_cast<uint16_t>(header.cupsInteger[1]),
-    };
+    this->lineSize = header.cupsBytesPerLine;
+    std::size_t stripLines = std::max<std::size_t>(this->stripSize / this->lineSize, 1);
+    this->stripBuffer.resize(stripLines * this->lineSize);
+    this->setg(nullptr, nullptr, nullptr);
+    return params;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "Core/RasterStreambuf.hpp"
 #include <cups/raster.h>
+#include <cstddef>
 #include <streambuf>
 #include <unistd.h>
 #include <vector>
@@ -10,15 +11,26 @@ private:
     int fd = STDIN_FILENO;
     unsigned linesRemain = 0;
     cups_raster_t* raster = nullptr;
-    std::vector<char_type> lineBuffer;
+    std::size_t stripSize;
+    std::size_t lineSize = 0;
+    std::vector<char_type> stripBuffer;
 
+    std::size_t readLines(char_type* dest, std::size_t lines);
     int_type underflow() override;
+    std::streamsize xsgetn(char_type* s, std::streamsize count) override;
 public:
-    CupsRasterStreambuf() noexcept = default;
+    static constexpr std::size_t DefaultStripSize = 64 * 1024;
+
+    // stripSize is the preferred number of bytes read per cupsRasterReadPixels call,
+    // 0 reads line by line
+    explicit CupsRasterStreambuf(std::size_t stripSize = DefaultStripSize) noexcept;
     ~CupsRasterStreambuf() noexcept override;
 
     bool Open(const char* file = nullptr) noexcept;
+    // Takes ownership of fd (except stdin)
+    bool Open(int fd) noexcept;
     void Close() noexcept;
 
     std::optional<Capt::PageParams> NextPage() override;
+    std::span<const char> NextLine() override;
 };
@@ -0,0 +1,329 @@
+#include "NativeRasterStreambuf.hpp"
+#include "RasterHeader.hpp"
+#include "Core/Log.hpp"
+#include "Core/RasterError.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using int_type = NativeRasterStreambuf::int_type;
+
+namespace {
+    constexpr std::uint32_t SyncV1 = 0x52615374; // RaSt
+    constexpr std::uint32_t SyncV2 = 0x52615332; // RaS2
+    constexpr std::uint32_t SyncV3 = 0x52615333; // RaS3
+
+    constexpr std::uint32_t bswap(std::uint32_t v) noexcept {
+        return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+
+    // Same range libcups swaps: everything from AdvanceDistance to the end of cupsReal
+    constexpr std::size_t SwapOffset = offsetof(cups_page_header2_t, AdvanceDistance);
+    constexpr std::size_t SwapCount = 81;
+    static_assert(SwapOffset + SwapCount * 4 <= sizeof(cups_page_header2_t));
+
+    void swapHeader(cups_page_header2_t& header) noexcept {
+        unsigned char* base = reinterpret_cast<unsigned char*>(&header) + SwapOffset;
+        for (std::size_t i = 0; i < SwapCount; i++) {
+            std::uint32_t v;
+            std::memcpy(&v, base + i * 4, 4);
+            v = bswap(v);
+            std::memcpy(base + i * 4, &v, 4);
+        }
+    }
+
+    constexpr bool whiteIsOne(unsigned colorSpace) noexcept {
+        switch (colorSpace) {
+        case CUPS_CSPACE_W:
+        case CUPS_CSPACE_RGB:
+        case CUPS_CSPACE_SW:
+        case CUPS_CSPACE_SRGB:
+        case CUPS_CSPACE_RGBW:
+        case CUPS_CSPACE_ADOBERGB:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+NativeRasterStreambuf::~NativeRasterStreambuf() noexcept {
+    this->Close();
+}
+
+bool NativeRasterStreambuf::Open(const char* file) noexcept {
+    if (file == nullptr) {
+        return this->Open(STDIN_FILENO);
+    }
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        Log::Debug() << "open() failed: " << strerror(errno);
+        return false;
+    }
+    return this->Open(fd);
+}
+
+bool NativeRasterStreambuf::Open(int fd) noexcept {
+    assert(this->pos == nullptr);
+    this->fd = fd;
+    struct stat st;
+    if (fstat(this->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+            this->map = map;
+            this->mapSize = st.st_size;
+            this->pos = static_cast<const unsigned char*>(map);
+            this->end = this->pos + this->mapSize;
+            this->inputEof = true;
+            Log::Debug() << "Raster file mapped (" << this->mapSize << " bytes)";
+        } else {
+            Log::Debug() << "mmap() failed: " << strerror(errno) << ", reading instead";
+        }
+    }
+    if (this->map == nullptr) {
+        try {
+            this->readBuffer.resize(ReadBlockSize);
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+        this->pos = this->readBuffer.data();
+        this->end = this->pos;
+    }
+    return this->readSync();
+}
+
+void NativeRasterStreambuf::Close() noexcept {
+    if (this->map != nullptr) {
+        munmap(this->map, this->mapSize);
+        this->map = nullptr;
+    }
+    if (this->fd >= 0 && this->fd != STDIN_FILENO) {
+        close(this->fd);
+    }
+    this->fd = -1;
+    this->pos = nullptr;
+    this->end = nullptr;
+}
+
+// Makes at least count contiguous bytes available at pos
+bool NativeRasterStreambuf::fill(std::size_t count) {
+    while (static_cast<std::size_t>(this->end - this->pos) < count) {
+        if (this->inputEof) {
+            return false;
+        }
+        std::size_t avail = this->end - this->pos;
+        if (this->readBuffer.size() < count) {
+            std::vector<unsigned char> buffer(std::max(count, this->readBuffer.size() * 2));
+            std::copy_n(this->pos, avail, buffer.data());
+            this->readBuffer = std::move(buffer);
+        } else if (this->pos != this->readBuffer.data()) {
+            std::memmove(this->readBuffer.data(), this->pos, avail);
+        }
+        this->pos = this->readBuffer.data();
+        this->end = this->pos + avail;
+
+        ssize_t res = read(this->fd, this->readBuffer.data() + avail, this->readBuffer.size() - avail);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Log::Debug() << "read() failed: " << strerror(errno);
+            throw RasterError("read failed");
+        }
+        if (res == 0) {
+            this->inputEof = true;
+        }
+        this->end += res;
+    }
+    return true;
+}
+
+const unsigned char* NativeRasterStreambuf::take(std::size_t count) {
+    if (!this->fill(count)) {
+        throw RasterError("unexpected EOF");
+    }
+    const unsigned char* p = this->pos;
+    this->pos += count;
+    return p;
+}
+
+bool NativeRasterStreambuf::readSync() {
+    std::uint32_t sync;
+    try {
+        if (!this->fill(sizeof(sync))) {
+            Log::Debug() << "Raster stream is empty";
+            return false;
+        }
+    } catch (const RasterError&) {
+        return false;
+    }
+    std::memcpy(&sync, this->pos, sizeof(sync));
+    this->pos += sizeof(sync);
+    this->swapped = sync == bswap(SyncV1) || sync == bswap(SyncV2) || sync == bswap(SyncV3);
+    if (this->swapped) {
+        sync = bswap(sync);
+    }
+    if (sync != SyncV1 && sync != SyncV2 && sync != SyncV3) {
+        Log::Debug() << "Unsupported raster sync word 0x" << std::hex << sync;
+        return false;
+    }
+    this->compressed = sync == SyncV2;
+    Log::Debug() << "Raster stream v" << (sync == SyncV1 ? 1 : (sync == SyncV2 ? 2 : 3))
+        << (this->swapped ? " (byte swapped)" : "");
+    return true;
+}
+
+// v2 line: a run-length encoded sequence of pixels,
+// runs are expanded with memset/memcpy straight into dest
+void NativeRasterStreambuf::decodeLine(unsigned char* dest) {
+    std::size_t remain = this->lineSize;
+    while (remain > 0) {
+        unsigned count = *this->take(1);
+        if (count == 128) {
+            std::memset(dest, this->clearByte, remain);
+            break;
+        }
+        if (count > 128) {
+            std::size_t n = std::min((257 - count) * this->pixelSize, remain);
+            std::memcpy(dest, this->take(n), n);
+            dest += n;
+            remain -= n;
+            continue;
+        }
+        std::size_t n = std::min((count + 1) * this->pixelSize, remain);
+        const unsigned char* pixel = this->take(this->pixelSize);
+        if (this->pixelSize == 1) {
+            std::memset(dest, *pixel, n);
+        } else {
+            for (std::size_t i = 0; i < n; i++) {
+                dest[i] = pixel[i % this->pixelSize];
+            }
+        }
+        dest += n;
+        remain -= n;
+    }
+}
+
+// Decodes one line into dest, keeping a copy when the line group repeats
+std::size_t NativeRasterStreambuf::readLine(char_type* dest) {
+    assert(this->linesRemain != 0);
+    unsigned char* out = reinterpret_cast<unsigned char*>(dest);
+    if (!this->compressed) {
+        std::memcpy(out, this->take(this->lineSize), this->lineSize);
+    } else if (this->lineRepeat != 0) {
+        std::memcpy(out, this->lineBuffer.data(), this->lineSize);
+        this->lineRepeat--;
+    } else {
+        this->lineRepeat = std::min<unsigned>(*this->take(1), this->linesRemain - 1);
+        this->decodeLine(out);
+        if (this->lineRepeat != 0 && dest != this->lineBuffer.data()) {
+            std::memcpy(this->lineBuffer.data(), out, this->lineSize);
+        }
+    }
+    this->linesRemain--;
+    return this->lineSize;
+}
+
+int_type NativeRasterStreambuf::underflow() {
+    if (this->gptr() < this->egptr()) {
+        return traits_type::to_int_type(*this->gptr());
+    }
+    if (this->linesRemain == 0) {
+        return traits_type::eof();
+    }
+    if (!this->compressed) {
+        // Expose as many whole lines of the input window as possible without copying
+        if (!this->fill(this->lineSize)) {
+            throw RasterError("unexpected EOF");
+        }
+        std::size_t lines = std::min<std::size_t>((this->end - this->pos) / this->lineSize, this->linesRemain);
+        char_type* start = const_cast<char_type*>(reinterpret_cast<const char_type*>(this->pos));
+        this->pos += lines * this->lineSize;
+        this->linesRemain -= lines;
+        this->setg(start, start, start + lines * this->lineSize);
+        return traits_type::to_int_type(*this->gptr());
+    }
+    char_type* start = this->lineBuffer.data();
+    this->readLine(start);
+    this->setg(start, start, start + this->lineSize);
+    return traits_type::to_int_type(*this->gptr());
+}
+
+std::streamsize NativeRasterStreambuf::xsgetn(char_type* s, std::streamsize count) {
+    std::streamsize total = 0;
+    while (total < count) {
+        std::streamsize avail = this->egptr() - this->gptr();
+        if (avail > 0) {
+            std::streamsize n = std::min(avail, count - total);
+            std::copy_n(this->gptr(), n, s + total);
+            this->gbump(static_cast<int>(n));
+            total += n;
+            continue;
+        }
+        if (this->linesRemain == 0) {
+            break;
+        }
+        if (static_cast<std::size_t>(count - total) >= this->lineSize) {
+            total += this->readLine(s + total);
+        } else if (traits_type::eq_int_type(this->underflow(), traits_type::eof())) {
+            break;
+        }
+    }
+    return total;
+}
+
+std::span<const char> NativeRasterStreambuf::NextLine() {
+    if (this->gptr() < this->egptr()) {
+        assert(static_cast<std::size_t>(this->egptr() - this->gptr()) >= this->lineSize);
+        std::span<const char> line(this->gptr(), this->lineSize);
+        this->gbump(static_cast<int>(this->lineSize));
+        return line;
+    }
+    if (this->linesRemain == 0) {
+        return {};
+    }
+    if (!this->compressed) {
+        const char_type* start = reinterpret_cast<const char_type*>(this->take(this->lineSize));
+        this->linesRemain--;
+        return {start, this->lineSize};
+    }
+    this->readLine(this->lineBuffer.data());
+    return {this->lineBuffer.data(), this->lineSize};
+}
+
+std::optional<Capt::PageParams> NativeRasterStreambuf::NextPage() {
+    assert(this->pos != nullptr);
+    assert(this->linesRemain == 0);
+    this->setg(nullptr, nullptr, nullptr);
+    if (!this->fill(1)) {
+        Log::Debug() << "No more pages";
+        return std::nullopt;
+    }
+    cups_page_header2_t header;
+    std::memcpy(&header, this->take(sizeof(header)), sizeof(header));
+    if (this->swapped) {
+        swapHeader(header);
+    }
+    Capt::PageParams params = MakePageParams(header);
+    if (header.cupsBytesPerLine != (static_cast<std::size_t>(header.cupsWidth) * header.cupsBitsPerPixel + 7) / 8) {
+        Log::Debug() << "cupsBytesPerLine=" << header.cupsBytesPerLine << " does not match cupsWidth=" << header.cupsWidth;
+        throw RasterError("invalid raster line size");
+    }
+    this->lineSize = header.cupsBytesPerLine;
+    this->pixelSize = header.cupsColorOrder == CUPS_ORDER_CHUNKED
+        ? (header.cupsBitsPerPixel + 7) / 8
+        : (header.cupsBitsPerColor + 7) / 8;
+    this->clearByte = whiteIsOne(header.cupsColorSpace) ? 0xff : 0x00;
+    this->linesRemain = header.cupsHeight;
+    this->lineRepeat = 0;
+    this->lineBuffer.resize(this->lineSize);
+    return params;
+}
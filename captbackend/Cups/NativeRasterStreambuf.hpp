@@ -0,0 +1,59 @@
+#pragma once
+#include "Core/RasterStreambuf.hpp"
+#include <cups/raster.h>
+#include <cstddef>
+#include <streambuf>
+#include <unistd.h>
+#include <vector>
+
+// In-tree CUPS raster (v1, v2 and v3) reader.
+// Regular files are mapped into memory, pipes are read in large blocks.
+class NativeRasterStreambuf : public RasterStreambuf {
+private:
+    int fd = STDIN_FILENO;
+
+    // Input window: the whole mapping or the valid part of readBuffer
+    const unsigned char* pos = nullptr;
+    const unsigned char* end = nullptr;
+    void* map = nullptr;
+    std::size_t mapSize = 0;
+    std::vector<unsigned char> readBuffer;
+    bool inputEof = false;
+
+    bool compressed = false;
+    bool swapped = false;
+
+    std::size_t lineSize = 0;
+    std::size_t pixelSize = 1;
+    unsigned char clearByte = 0;
+    unsigned linesRemain = 0;
+    // Repetitions of lineBuffer left from the current v2 line group
+    unsigned lineRepeat = 0;
+    std::vector<char_type> lineBuffer;
+
+    bool fill(std::size_t count);
+    const unsigned char* take(std::size_t count);
+    bool readSync();
+
+    void decodeLine(unsigned char* dest);
+    std::size_t readLine(char_type* dest);
+
+    int_type underflow() override;
+    std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+public:
+    static constexpr std::size_t ReadBlockSize = 1024 * 1024;
+
+    NativeRasterStreambuf() noexcept = default;
+    ~NativeRasterStreambuf() noexcept override;
+
+    NativeRasterStreambuf(const NativeRasterStreambuf&) = delete;
+    NativeRasterStreambuf& operator=(const NativeRasterStreambuf&) = delete;
+
+    bool Open(const char* file = nullptr) noexcept;
+    // Takes ownership of fd (except stdin)
+    bool Open(int fd) noexcept;
+    void Close() noexcept;
+
+    std::optional<Capt::PageParams> NextPage() override;
+    std::span<const char> NextLine() override;
+};
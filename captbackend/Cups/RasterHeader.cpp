@@ -0,0 +1,42 @@
+#include "RasterHeader.hpp"
+#include "Core/Log.hpp"
+#include "Core/RasterError.hpp"
+#include <cstdint>
+
+Capt::PageParams MakePageParams(const cups_page_header2_t& header) {
+    if (header.cupsBitsPerPixel != 1 || header.cupsBitsPerColor != 1 || header.cupsNumColors != 1) {
+        Log::Debug() << "Invalid raster format: cupsBitsPerPixel=" << header.cupsBitsPerPixel
+            << " cupsBitsPerColor=" << header.cupsBitsPerColor
+            << " cupsNumColors=" << header.cupsNumColors;
+        throw RasterError("invalid raster format");
+    }
+    if (header.cupsBytesPerLine == 0) {
+        throw RasterError("invalid raster line size");
+    }
+    Log::Debug() << "Read header " << header.cupsBytesPerLine << 'x' << header.cupsHeight << " (" << header.cupsPageSizeName << ')';
+    // Margins:
+    //   left  : cupsImagingBBox[0]
+    //   bottom: cupsImagingBBox[1]
+    //   right : cupsPageSize[0] - cupsImagingBBox[2]
+    //   top   : cupsPageSize[1] - cupsImagingBBox[3]
+    uint16_t marginLeft = header.cupsImagingBBox[0] / 72.0f * header.HWResolution[0];
+    uint16_t marginTop = (header.cupsPageSize[1] - header.cupsImagingBBox[3]) / 72.0f * header.HWResolution[0];
+    if (marginTop == 0) {
+        marginTop = 1;
+    }
+    Log::Debug() << "Page margins: left=" << marginLeft << " top=" << marginTop;
+    return Capt::PageParams{
+        .PaperSize = static_cast<uint8_t>(header.cupsInteger[2]),
+        .TonerDensity = static_cast<uint8_t>(header.cupsCompression),
+        .Mode = static_cast<uint8_t>(header.cupsMediaType),
+        .Resolution = header.HWResolution[0] == 600 ? Capt::ResolutionIdx::RES_600 : Capt::ResolutionIdx::RES_300,
+        .SmoothEnable = header.cupsInteger[5] != 0,
+        .TonerSaving = header.cupsInteger[6] != 0,
+        .MarginLeft = marginLeft,
+        .MarginTop = marginTop,
+        .ImageLineSize = static_cast<uint16_t>(header.cupsBytesPerLine),
+        .ImageLines = static_cast<uint16_t>(header.cupsHeight),
+        .PaperWidth = static_cast<uint16_t>(header.cupsInteger[0]),
+        .PaperHeight = static_cast<uint16_t>(header.cupsInteger[1]),
+    };
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <cups/raster.h>
+#include <libcapt/Protocol/PageParams.hpp>
+
+// Validates the page header and converts it to the CAPT page parameters
+[[nodiscard]] Capt::PageParams MakePageParams(const cups_page_header2_t& header);
@@ -0,0 +1,111 @@
+#include "Client.hpp"
+#include "Config.hpp"
+#include "Core/Log.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <cups/backend.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::literals::chrono_literals;
+
+static int connectTo(const std::filesystem::path& path) noexcept {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Starts this executable in daemon mode, detached from the job
+static bool spawnDaemon(const std::filesystem::path& socketPath) noexcept {
+    std::string path = socketPath.string();
+    pid_t pid = fork();
+    if (pid < 0) {
+        Log::Debug() << "fork() failed: " << std::strerror(errno);
+        return false;
+    }
+    if (pid == 0) {
+        // Only async-signal-safe calls from here on
+        setsid();
+        if (fork() != 0) {
+            _exit(0);
+        }
+        // Pipes of the CUPS side channel and back channel must not be kept open
+        close_range(3, ~0U, 0);
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execl("/proc/self/exe", CAPTBACKEND_NAME, "--daemon", path.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return true;
+}
+
+std::optional<int> RunInDaemon(StopToken stopToken, const std::filesystem::path& socketPath, const JobRequest& request, int rasterFd) {
+    int sock = connectTo(socketPath);
+    if (sock < 0) {
+        Log::Debug() << "Starting daemon";
+        if (!spawnDaemon(socketPath)) {
+            return std::nullopt;
+        }
+        auto deadline = std::chrono::steady_clock::now() + 3s;
+        while (sock < 0 && !stopToken.stop_requested() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(50ms);
+            sock = connectTo(socketPath);
+        }
+        if (sock < 0) {
+            Log::Debug() << "Daemon did not start";
+            return std::nullopt;
+        }
+    }
+    if (!SendRequest(sock, request, rasterFd, STDERR_FILENO)) {
+        close(sock);
+        return std::nullopt;
+    }
+    Log::Debug() << "Job handed to daemon";
+    bool cancelled = false;
+    while (true) {
+        pollfd pfd{sock, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0) {
+            break;
+        }
+        if (stopToken.stop_requested() && !cancelled) {
+            shutdown(sock, SHUT_WR);
+            cancelled = true;
+        }
+    }
+    std::optional<int> status = ReceiveResult(sock);
+    close(sock);
+    if (!status) {
+        Log::Critical() << "Daemon exited during the job";
+        return CUPS_BACKEND_FAILED;
+    }
+    if (*status == JobRejected) {
+        Log::Debug() << "Daemon is exiting and rejected the job";
+        return std::nullopt;
+    }
+    return status;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "Protocol.hpp"
+#include "Core/StopToken.hpp"
+#include <filesystem>
+#include <optional>
+
+// Hands the job to the daemon listening at socketPath (see Daemon.hpp), starting it if needed.
+// The daemon logs to our stderr. Stopping cancels the job in the daemon.
+// Returns the exit status of the job, or std::nullopt if the daemon could not take it.
+[[nodiscard]] std::optional<int> RunInDaemon(StopToken stopToken, const std::filesystem::path& socketPath, const JobRequest& request, int rasterFd);
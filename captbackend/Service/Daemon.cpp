@@ -0,0 +1,544 @@
+#include "Daemon.hpp"
+#include "FdWriter.hpp"
+#include "PrintJob.hpp"
+#include "Core/BufferedWriter.hpp"
+#include "Core/CaptPrinter.hpp"
+#include "Core/Log.hpp"
+#include "Core/RangeSplitter.hpp"
+#include "Cups/CupsOptions.hpp"
+#include "UsbBackend/UsbError.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cups/backend.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std::literals::chrono_literals;
+
+// The backend sends its request right after connecting, a stalled client must not hold up the accept loop
+static constexpr auto RequestTimeout = 2s;
+
+static inline void closeFd(int fd) noexcept {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+Daemon::Session::Session(std::string uri, UsbPrinter printer, unsigned transfers)
+    : Uri(std::move(uri)), Printer(std::move(printer)), Streambuf(this->Printer, transfers), Stream(&this->Streambuf) {
+    this->Stream.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+}
+
+Daemon::Daemon(UsbBackend& backend, DeviceCache& cache, std::filesystem::path pageCacheDir, std::chrono::seconds linger, DaemonConfig config, unsigned encoderThreads)
+    : backend(backend), cache(cache), pageCacheDir(std::move(pageCacheDir)), linger(linger), config(std::move(config)), encoders(encoderThreads) {}
+
+Daemon::~Daemon() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto& [uri, worker] : this->workers) {
+            worker->Exiting = true;
+        }
+    }
+    this->cond.notify_all();
+    for (auto& [uri, worker] : this->workers) {
+        if (worker->Thread.joinable()) {
+            worker->Thread.join();
+        }
+    }
+    closeFd(this->listenFd);
+    closeFd(this->lockFd);
+}
+
+bool Daemon::Listen(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    // The lock is held for the lifetime of the daemon, a socket file without it is stale
+    std::string lockPath = path.string() + ".lock";
+    this->lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (this->lockFd < 0 || flock(this->lockFd, LOCK_EX | LOCK_NB) != 0) {
+        Log::Debug() << "Daemon is already running or " << lockPath << " can't be locked";
+        return false;
+    }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(addr.sun_path)) {
+        Log::Critical() << "Socket path is too long: " << path.string();
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    this->listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    // Jobs carry raw printer access, only the owner (root or lp) may connect
+    mode_t mask = umask(0077);
+    bool ok = this->listenFd >= 0 && bind(this->listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0
+        && listen(this->listenFd, 8) == 0;
+    umask(mask);
+    if (!ok) {
+        Log::Critical() << "Can't listen on " << path.string() << ": " << std::strerror(errno);
+        return false;
+    }
+    this->socketPath = path;
+    Log::Debug() << "Listening on " << path.string();
+    return true;
+}
+
+std::chrono::seconds Daemon::jobLinger(const JobRequest& request) const noexcept {
+    // The unit stays claimed meanwhile, the build setting is the upper bound
+    return std::min(std::chrono::seconds(request.Linger), this->linger);
+}
+
+void Daemon::Adopt(int fd) noexcept {
+    this->listenFd = fd;
+}
+
+void Daemon::Run(StopToken stopToken) {
+    Log::Debug() << "Compressing pages on " << this->encoders.Threads() << " shared encoder threads";
+    auto startTime = std::chrono::steady_clock::now();
+    bool started = false;
+    while (!stopToken.stop_requested()) {
+        pollfd pfd{this->listenFd, POLLIN, 0};
+        // Bounded, so that stop requests and exited workers are noticed
+        int res = poll(&pfd, 1, 200);
+        if (res < 0 && errno != EINTR) {
+            Log::Critical() << "poll() failed: " << std::strerror(errno);
+            break;
+        }
+        if (res > 0) {
+            int conn = accept4(this->listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn >= 0) {
+                timeval timeout{std::chrono::duration_cast<std::chrono::seconds>(RequestTimeout).count(), 0};
+                setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                Request request{conn, {}, -1, -1};
+                if (auto job = ReceiveRequest(conn, request.RasterFd, request.LogFd)) {
+                    request.Job = std::move(*job);
+                    this->dispatch(stopToken, std::move(request));
+                } else {
+                    close(conn);
+                }
+            }
+        }
+        this->reap();
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->workers.empty()) {
+            started = true;
+        } else if (started || std::chrono::steady_clock::now() - startTime >= this->linger) {
+            Log::Debug() << "No printers in use, exiting";
+            break;
+        }
+    }
+    // New backends start another daemon, the ones already connected print by themselves
+    if (!this->socketPath.empty()) {
+        unlink(this->socketPath.c_str());
+    }
+    fcntl(this->listenFd, F_SETFL, fcntl(this->listenFd, F_GETFL) | O_NONBLOCK);
+    while (true) {
+        int conn = accept4(this->listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            break;
+        }
+        SendResult(conn, JobRejected);
+        close(conn);
+    }
+}
+
+void Daemon::dispatch(StopToken stopToken, Request request) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto it = this->workers.find(request.Job.Uri);
+    if (it != this->workers.end() && it->second->Exiting) {
+        // The printer is being released, the new worker has to wait for it
+        std::unique_ptr<Worker> old = std::move(it->second);
+        this->workers.erase(it);
+        lock.unlock();
+        if (old->Thread.joinable()) {
+            old->Thread.join();
+        }
+        lock.lock();
+        it = this->workers.end();
+    }
+    if (it == this->workers.end()) {
+        auto worker = std::make_unique<Worker>();
+        worker->Uri = request.Job.Uri;
+        worker->Linger = this->jobLinger(request.Job);
+        Worker& ref = *worker;
+        it = this->workers.emplace(worker->Uri, std::move(worker)).first;
+        Log::Debug() << "Starting worker for " << ref.Uri;
+        ref.Thread = std::thread(&Daemon::work, this, stopToken, std::ref(ref));
+    }
+    it->second->Queue.push_back(std::move(request));
+    this->cond.notify_all();
+}
+
+void Daemon::reap() {
+    std::vector<std::unique_ptr<Worker>> done;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto it = this->workers.begin(); it != this->workers.end();) {
+            if (it->second->Done) {
+                done.push_back(std::move(it->second));
+                it = this->workers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto& worker : done) {
+        // A lent worker that never ran is released by the borrower
+        if (worker->Thread.joinable()) {
+            worker->Thread.join();
+        }
+    }
+}
+
+void Daemon::work(StopToken stopToken, Worker& worker) noexcept {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto idleSince = std::chrono::steady_clock::now();
+    while (true) {
+        // The fallback StopToken has no callbacks, so the wait is bounded
+        this->cond.wait_for(lock, 200ms, [&] { return !worker.Lent && (worker.Exiting || !worker.Queue.empty()); });
+        if (worker.Lent) {
+            // The borrower is using the printer
+            idleSince = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (!worker.Queue.empty() && !worker.Exiting && !stopToken.stop_requested()) {
+            Request request = std::move(worker.Queue.front());
+            worker.Queue.pop_front();
+            worker.Busy = true;
+            lock.unlock();
+            this->serve(stopToken, worker, request);
+            lock.lock();
+            worker.Busy = false;
+            idleSince = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (worker.Exiting || stopToken.stop_requested() || std::chrono::steady_clock::now() - idleSince >= worker.Linger) {
+            break;
+        }
+    }
+    worker.Exiting = true;
+    // Jobs that came while stopping are not run
+    std::deque<Request> rejected = std::move(worker.Queue);
+    lock.unlock();
+    for (Request& request : rejected) {
+        closeFd(request.RasterFd);
+        closeFd(request.LogFd);
+        SendResult(request.Conn, JobRejected);
+        close(request.Conn);
+    }
+    Log::Debug() << "Worker for " << worker.Uri << " exiting";
+    this->release(worker);
+    lock.lock();
+    worker.Done = true;
+}
+
+void Daemon::serve(StopToken stopToken, Worker& worker, Request& request) {
+    worker.Linger = this->jobLinger(request.Job);
+    int conn = request.Conn;
+    int status;
+    {
+        FdWriter fdWriter(request.LogFd);
+        std::ostream fdStream(&fdWriter);
+        char logBuff[1024];
+        BufferedWriter writer(fdStream, logBuff);
+        std::ostream logStream(&writer);
+        Log::SetThreadLogStream(&logStream);
+
+        // The backend cancels the job by shutting the socket down, or exits when CUPS cancels it
+        StopSource jobStop;
+        std::atomic<bool> done = false;
+        std::thread monitor([&] {
+            while (!done) {
+                pollfd pfd{conn, POLLIN, 0};
+                if (poll(&pfd, 1, 100) > 0 || stopToken.stop_requested()) {
+                    jobStop.request_stop();
+                    break;
+                }
+            }
+        });
+        {
+            StateReporter reporter(logStream);
+            status = this->runJob(jobStop.get_token(), worker, request.Job, std::exchange(request.RasterFd, -1), reporter);
+        }
+        done = true;
+        monitor.join();
+        logStream.flush();
+        Log::SetThreadLogStream(nullptr);
+    }
+    close(request.LogFd);
+    SendResult(conn, status);
+    close(conn);
+}
+
+int Daemon::runJob(StopToken stopToken, Worker& worker, const JobRequest& request, int rasterFd, StateReporter& reporter) {
+    PrintOptions options = ParsePrintOptions(request.Copies.c_str(), request.Options.c_str());
+    options.PageCacheDir = this->pageCacheDir;
+    options.Encoders = &this->encoders;
+    try {
+        if (worker.Device) {
+            // The printer may have been unplugged or switched off while lingering
+            try {
+                CaptPrinter printer(worker.Device->Stream, reporter, options);
+                printer.GetStatus();
+                Log::Info() << "Reusing reserved unit";
+            } catch (const UsbError& e) {
+                Log::Debug() << "Reserved unit is gone (" << e.what() << "), reconnecting";
+                worker.Device.reset();
+            }
+        }
+        if (!worker.Device) {
+            reporter.SetReason("connecting-to-device", true);
+            std::optional<UsbPrinter> printer = ConnectByUri(stopToken, this->backend, this->cache, request.Uri);
+            reporter.SetReason("connecting-to-device", false);
+            if (!printer) {
+                closeFd(rasterFd);
+                return CUPS_BACKEND_OK;
+            }
+            worker.Device = std::make_unique<Session>(request.Uri, std::move(*printer), options.UsbTransfers);
+        }
+        if (!worker.Device->Reserved) {
+            CaptPrinter printer(worker.Device->Stream, reporter, options);
+            printer.ReserveUnit();
+            worker.Device->Reserved = true;
+            Log::Info() << "Unit reserved";
+        }
+        bool success;
+        std::vector<Worker*> helpers;
+        // Collated copies need all the pages of the job on one printer
+        bool collated = options.Collate && options.Copies > 1;
+        std::vector<std::string> pool = this->config.PoolOf(request.Uri);
+        if (!pool.empty() && !collated && request.ContentType == "application/vnd.cups-raster") {
+            helpers = this->borrow(worker, pool, options.UsbTransfers);
+        }
+        if (!helpers.empty()) {
+            try {
+                success = this->printPooled(stopToken, worker, helpers, options, std::exchange(rasterFd, -1), reporter);
+            } catch (...) {
+                for (Worker* helper : helpers) {
+                    this->giveBack(stopToken, *helper);
+                }
+                throw;
+            }
+            for (Worker* helper : helpers) {
+                this->giveBack(stopToken, *helper);
+            }
+        } else {
+            CaptPrinter printer(worker.Device->Stream, reporter, options);
+            success = RunJob(stopToken, printer, request.ContentType, options.NativeRaster, std::exchange(rasterFd, -1));
+        }
+        // A pooled job goes on when the printer of the worker fails, which releases it
+        if (worker.Device) {
+            Log::Debug() << "Keeping unit reserved for " << worker.Linger.count() << " s";
+        }
+        return success ? CUPS_BACKEND_OK : CUPS_BACKEND_FAILED;
+    } catch (...) {
+        LogJobError(std::current_exception());
+    }
+    closeFd(rasterFd);
+    // The state of the printer is unknown
+    this->release(worker);
+    return CUPS_BACKEND_FAILED;
+}
+
+std::vector<Daemon::Worker*> Daemon::borrow(Worker& worker, const std::vector<std::string>& pool, unsigned transfers) {
+    std::optional<PrinterInfo> self = GetPrinterInfo(worker.Device->Printer, this->cache);
+    if (!self) {
+        return {};
+    }
+    std::vector<Worker*> helpers;
+    for (UsbPrinter& p : this->backend.GetPrinters()) {
+        std::optional<PrinterInfo> info = GetPrinterInfo(p, this->cache);
+        if (!info || !info->IsCaptPrinter() || info->Model != self->Model || info->Serial == self->Serial) {
+            continue;
+        }
+        std::ostringstream uri;
+        info->WriteUri(uri);
+        if (std::ranges::find(pool, uri.str()) == pool.end()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        auto it = this->workers.find(uri.str());
+        if (it != this->workers.end()) {
+            // A lingering printer keeps its reserved unit
+            Worker& helper = *it->second;
+            if (!helper.Busy && !helper.Lent && !helper.Exiting && helper.Queue.empty() && helper.Device) {
+                helper.Lent = true;
+                helpers.push_back(&helper);
+            }
+            continue;
+        }
+        // The new worker takes the jobs that come for the printer in the meantime, and runs them afterwards
+        auto helper = std::make_unique<Worker>();
+        helper->Uri = uri.str();
+        helper->Linger = worker.Linger;
+        helper->Lent = true;
+        Worker& ref = *helper;
+        this->workers.emplace(ref.Uri, std::move(helper));
+        lock.unlock();
+        try {
+            p.Open();
+            ref.Device = std::make_unique<Session>(ref.Uri, std::move(p), transfers);
+            helpers.push_back(&ref);
+        } catch (const std::exception& e) {
+            Log::Debug() << "Can't open " << ref.Uri << ": " << e.what();
+            lock.lock();
+            ref.Lent = false;
+            ref.Done = true;
+        }
+    }
+    return helpers;
+}
+
+void Daemon::giveBack(StopToken stopToken, Worker& helper) noexcept {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    helper.Lent = false;
+    if (!helper.Thread.joinable() && !helper.Done) {
+        if (helper.Exiting) {
+            // The daemon is stopping, nobody else runs the worker
+            lock.unlock();
+            this->release(helper);
+            lock.lock();
+            helper.Done = true;
+        } else {
+            helper.Thread = std::thread(&Daemon::work, this, stopToken, std::ref(helper));
+        }
+    }
+    this->cond.notify_all();
+}
+
+bool Daemon::printPooled(StopToken stopToken, Worker& worker, const std::vector<Worker*>& helpers, const PrintOptions& options, int rasterFd, StateReporter& reporter) {
+    std::unique_ptr<RasterStreambuf> raster = OpenRaster(rasterFd, options.NativeRaster);
+    if (!raster) {
+        Log::Critical() << "Failed to open raster stream";
+        return false;
+    }
+    Log::Info() << "Sharing the job with " << helpers.size() << " more printers, "
+        << options.PoolRangePages << " pages at a time";
+    RangeSplitter splitter(*raster, options.PoolRangePages, options.LookaheadMemory);
+    std::ostream& logStream = Log::Stream();
+    unsigned copies = std::max(options.Copies, 1u);
+
+    struct Unit {
+        Worker* Printer;
+        RangeSplitter::Reader* Reader;
+        bool Failed = false;
+    };
+    std::vector<Unit> units;
+    units.push_back(Unit{&worker, &splitter.AddReader()});
+    for (Worker* helper : helpers) {
+        units.push_back(Unit{helper, &splitter.AddReader()});
+    }
+
+    // Each printer recovers from its own jams. A failed one hands the pages it has not sent to the others.
+    auto print = [&](Unit& unit) {
+        RangeSplitter::Reader& reader = *unit.Reader;
+        // The printers report through the reporter of the job, with the page numbers of the job.
+        // A printer counts its pages from the first one it takes here, copies included.
+        unsigned first = reader.Taken();
+        StateReporter unitReporter(reporter, [&reader, first, copies](unsigned page) {
+            unsigned index = first + (page - 1) / copies;
+            reader.Starting(index);
+            return reader.PageNumber(index) + 1;
+        });
+        bool success = false;
+        try {
+            CaptPrinter printer(unit.Printer->Device->Stream, unitReporter, options);
+            if (!unit.Printer->Device->Reserved) {
+                printer.ReserveUnit();
+                unit.Printer->Device->Reserved = true;
+            }
+            success = printer.Print(stopToken, reader);
+        } catch (...) {
+            LogJobError(std::current_exception());
+            // The state of the printer is unknown
+            this->release(*unit.Printer);
+        }
+        if (success) {
+            reader.Finish();
+            return;
+        }
+        unit.Failed = true;
+        std::vector<RangeSplitter::Range> handedOver = reader.Fail();
+        if (!handedOver.empty() && !stopToken.stop_requested()) {
+            auto log = Log::Warning();
+            log << "Pages";
+            for (std::size_t i = 0; i < handedOver.size(); i++) {
+                log << (i == 0 ? " " : ", ") << (handedOver[i].first + 1) << '-' << handedOver[i].second;
+            }
+            log << " of " << unit.Printer->Uri << " go to the other printers";
+        }
+    };
+
+    // The pages of a printer that fails after the others have finished are printed in another round
+    for (unsigned round = 0; ; round++) {
+        if (round != 0) {
+            Log::Info() << splitter.Left() << " pages left by failed printers, printing them";
+        }
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < units.size(); i++) {
+            if (!units[i].Failed) {
+                threads.emplace_back([&, unit = &units[i]] {
+                    Log::SetThreadLogStream(&logStream);
+                    print(*unit);
+                });
+            }
+        }
+        if (!units[0].Failed) {
+            print(units[0]);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        bool survivors = std::ranges::any_of(units, [](const Unit& unit) { return !unit.Failed; });
+        if (splitter.Left() == 0 || !survivors || stopToken.stop_requested()) {
+            break;
+        }
+    }
+
+    bool success = !stopToken.stop_requested() && splitter.Left() == 0;
+    for (const Unit& unit : units) {
+        std::vector<RangeSplitter::Range> ranges = unit.Reader->Printed();
+        if (ranges.empty()) {
+            continue;
+        }
+        auto log = Log::Info();
+        log << "Pages";
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            log << (i == 0 ? " " : ", ") << (ranges[i].first + 1) << '-' << ranges[i].second;
+        }
+        log << " printed on " << unit.Printer->Uri;
+    }
+    if (!success && splitter.Left() != 0) {
+        Log::Critical() << splitter.Left() << " pages were not printed, no printer is left";
+    }
+    return success;
+}
+
+void Daemon::release(Worker& worker) noexcept {
+    if (!worker.Device) {
+        return;
+    }
+    if (worker.Device->Reserved) {
+        try {
+            StateReporter reporter(Log::Stream());
+            CaptPrinter printer(worker.Device->Stream, reporter);
+            Log::Debug() << "Releasing unit...";
+            printer.GoOffline();
+            printer.ReleaseUnit();
+            Log::Debug() << "Unit released";
+        } catch (const std::exception& e) {
+            Log::Debug() << "Failed to release unit: " << e.what();
+        }
+    }
+    worker.Device.reset();
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "DaemonConfig.hpp"
+#include "Protocol.hpp"
+#include "Core/DeviceCache.hpp"
+#include "Core/PrintOptions.hpp"
+#include "Core/EncoderPool.hpp"
+#include "Core/StateReporter.hpp"
+#include "Core/StopToken.hpp"
+#include "UsbBackend/UsbBackend.hpp"
+#include "UsbBackend/UsbPrinter.hpp"
+#include "UsbBackend/UsbStreambuf.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Long-lived process that keeps the printers open and their units reserved between jobs,
+// so that back-to-back jobs skip enumeration, reset, ReserveUnit() and warm-up.
+// Started on demand by the backend (see Client.hpp) or by socket activation.
+// Each printer has a worker thread running its jobs one at a time, the printers share
+// the libusb context of the backend and the encoder threads.
+// A worker exits when no job comes within the linger period of the last one,
+// the daemon exits when no worker is left.
+// A job for a printer of a pool (see DaemonConfig) is shared with the idle printers of the pool (see RangeSplitter).
+// Jobs it does not start are handed back (see JobRejected).
+class Daemon {
+private:
+    // The opened printer, the stream keeps referring to it
+    struct Session {
+        std::string Uri;
+        UsbPrinter Printer;
+        UsbStreambuf Streambuf;
+        std::iostream Stream;
+        bool Reserved = false;
+
+        explicit Session(std::string uri, UsbPrinter printer, unsigned transfers);
+    };
+
+    // A connection waiting for its job to run
+    struct Request {
+        int Conn;
+        JobRequest Job;
+        int RasterFd;
+        int LogFd;
+    };
+
+    struct Worker {
+        std::string Uri;
+        std::deque<Request> Queue;
+        std::unique_ptr<Session> Device;
+        std::chrono::seconds Linger;
+        // Running a job
+        bool Busy = false;
+        // The printer prints a part of a job of another worker (see borrow())
+        bool Lent = false;
+        // Set once the worker does not take jobs anymore
+        bool Exiting = false;
+        bool Done = false;
+        std::thread Thread;
+    };
+
+    UsbBackend& backend;
+    DeviceCache& cache;
+    std::filesystem::path pageCacheDir;
+    std::chrono::seconds linger;
+    DaemonConfig config;
+    EncoderPool encoders;
+
+    int listenFd = -1;
+    int lockFd = -1;
+    std::filesystem::path socketPath;
+
+    // Guards the workers and their queues
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<std::string, std::unique_ptr<Worker>> workers;
+
+    [[nodiscard]] std::chrono::seconds jobLinger(const JobRequest& request) const noexcept;
+    void dispatch(StopToken stopToken, Request request);
+    // Joins the workers that have exited
+    void reap();
+    void work(StopToken stopToken, Worker& worker) noexcept;
+    void serve(StopToken stopToken, Worker& worker, Request& request);
+    int runJob(StopToken stopToken, Worker& worker, const JobRequest& request, int rasterFd, StateReporter& reporter);
+    // Takes the idle printers with the given URIs and of the same model as the one of the worker,
+    // opened and with a worker of their own
+    std::vector<Worker*> borrow(Worker& worker, const std::vector<std::string>& pool, unsigned transfers);
+    void giveBack(StopToken stopToken, Worker& helper) noexcept;
+    // Prints the job on the printer of the worker and the helpers, splitting the pages into ranges.
+    // The pages of a failed printer are printed by the others, the printers that fail with an error are released.
+    bool printPooled(StopToken stopToken, Worker& worker, const std::vector<Worker*>& helpers, const PrintOptions& options, int rasterFd, StateReporter& reporter);
+    // Takes the printer offline and releases the unit
+    void release(Worker& worker) noexcept;
+public:
+    // Jobs log to the stream of their backend, the rest goes to the log stream of the daemon.
+    // Linger is the time to wait for the first job.
+    explicit Daemon(UsbBackend& backend, DeviceCache& cache, std::filesystem::path pageCacheDir, std::chrono::seconds linger, DaemonConfig config = {}, unsigned encoderThreads = 0);
+    ~Daemon() noexcept;
+
+    Daemon(const Daemon&) = delete;
+    Daemon& operator=(const Daemon&) = delete;
+
+    // Fails if another daemon is listening at the path
+    [[nodiscard]] bool Listen(const std::filesystem::path& path);
+    // Uses a socket passed by the service manager
+    void Adopt(int fd) noexcept;
+
+    void Run(StopToken stopToken);
+};
@@ -0,0 +1,55 @@
+#include "DaemonConfig.hpp"
+#include "Core/Log.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+DaemonConfig DaemonConfig::Parse(std::istream& in) {
+    DaemonConfig config;
+    std::string line;
+    for (unsigned number = 1; std::getline(in, line); number++) {
+        std::istringstream words(line);
+        std::string directive;
+        if (!(words >> directive) || directive.starts_with('#')) {
+            continue;
+        }
+        if (directive != "Pool") {
+            Log::Warning() << "Ignoring unknown directive " << directive << " on line " << number;
+            continue;
+        }
+        std::vector<std::string> pool;
+        for (std::string uri; words >> uri;) {
+            pool.push_back(std::move(uri));
+        }
+        if (pool.size() < 2) {
+            Log::Warning() << "Ignoring pool of less than two printers on line " << number;
+            continue;
+        }
+        config.Pools.push_back(std::move(pool));
+    }
+    return config;
+}
+
+DaemonConfig DaemonConfig::Load(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return {};
+    }
+    Log::Debug() << "Reading " << path.string();
+    return Parse(file);
+}
+
+std::vector<std::string> DaemonConfig::PoolOf(std::string_view uri) const {
+    std::vector<std::string> res;
+    for (const std::vector<std::string>& pool : this->Pools) {
+        if (std::ranges::find(pool, uri) == pool.end()) {
+            continue;
+        }
+        for (const std::string& other : pool) {
+            if (other != uri && std::ranges::find(res, other) == res.end()) {
+                res.push_back(other);
+            }
+        }
+    }
+    return res;
+}
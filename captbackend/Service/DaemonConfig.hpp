@@ -0,0 +1,23 @@
+#pragma once
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Settings of the daemon made by the administrator, one per line:
+//   # Comment
+//   Pool <device URI> <device URI>...
+// A job for a printer of a pool is shared with the idle printers of the same pool,
+// jobs cannot reach any other printer.
+struct DaemonConfig {
+    std::vector<std::vector<std::string>> Pools;
+
+    // Invalid lines are skipped
+    [[nodiscard]] static DaemonConfig Parse(std::istream& in);
+    // A missing file is an empty config
+    [[nodiscard]] static DaemonConfig Load(const std::filesystem::path& path);
+
+    // The other printers of the pool of the URI, empty if it is in none
+    [[nodiscard]] std::vector<std::string> PoolOf(std::string_view uri) const;
+};
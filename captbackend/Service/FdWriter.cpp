@@ -0,0 +1,30 @@
+#include "FdWriter.hpp"
+#include <cerrno>
+#include <unistd.h>
+
+using int_type = FdWriter::int_type;
+
+FdWriter::FdWriter(int fd) noexcept : fd(fd) {}
+
+int_type FdWriter::overflow(int_type c) noexcept {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    char_type ch = traits_type::to_char_type(c);
+    return this->xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
+
+std::streamsize FdWriter::xsputn(const char_type* s, std::streamsize count) noexcept {
+    std::streamsize written = 0;
+    while (written < count) {
+        ssize_t res = write(this->fd, s + written, static_cast<std::size_t>(count - written));
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            break;
+        }
+        written += res;
+    }
+    return written;
+}
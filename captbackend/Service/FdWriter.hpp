@@ -0,0 +1,14 @@
+#pragma once
+#include <streambuf>
+
+// Unbuffered stream to a file descriptor that does not own it, errors are ignored.
+// Meant to be wrapped by BufferedWriter.
+class FdWriter : public std::streambuf {
+private:
+    int fd;
+
+    int_type overflow(int_type c = traits_type::eof()) noexcept override;
+    std::streamsize xsputn(const char_type* s, std::streamsize count) noexcept override;
+public:
+    explicit FdWriter(int fd) noexcept;
+};
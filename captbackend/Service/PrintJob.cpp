@@ -0,0 +1,114 @@
+#include "PrintJob.hpp"
+#include "Core/Log.hpp"
+#include "Core/RasterError.hpp"
+#include "Cups/CupsRasterStreambuf.hpp"
+#include "Cups/NativeRasterStreambuf.hpp"
+#include "UsbBackend/UsbError.hpp"
+#include <libcapt/UnexpectedBehaviourError.hpp>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+template<typename T>
+static std::unique_ptr<RasterStreambuf> openRaster(int fd) {
+    auto raster = std::make_unique<T>();
+    if (!raster->Open(fd)) {
+        return nullptr;
+    }
+    return raster;
+}
+
+std::unique_ptr<RasterStreambuf> OpenRaster(int fd, bool nativeRaster) {
+    return nativeRaster ? openRaster<NativeRasterStreambuf>(fd) : openRaster<CupsRasterStreambuf>(fd);
+}
+
+std::optional<PrinterInfo> GetPrinterInfo(UsbPrinter& printer, DeviceCache& cache, bool* cached) {
+    std::string key = printer.CacheKey();
+    auto info = cache.Find(key);
+    if (cached != nullptr) {
+        *cached = info.has_value();
+    }
+    if (info) {
+        return info;
+    }
+    info = printer.GetPrinterInfo();
+    if (info) {
+        cache.Insert(key, *info);
+    }
+    return info;
+}
+
+static bool matchesUri(const std::optional<PrinterInfo>& info, std::string_view uri) {
+    return info && info->IsCaptPrinter() && info->HasUri(uri);
+}
+
+std::optional<UsbPrinter> ConnectByUri(StopToken stopToken, UsbBackend& backend, DeviceCache& cache, std::string_view uri) {
+    // Devices whose identity was read from the device itself while waiting, they are not asked again
+    std::set<std::string, std::less<>> verified;
+    while (!stopToken.stop_requested()) {
+        unsigned long arrivals = backend.Arrivals();
+        std::vector<UsbPrinter> printers = backend.GetPrinters();
+        for (UsbPrinter& p : printers) {
+            bool cached;
+            auto info = GetPrinterInfo(p, cache, &cached);
+            if (cached && !matchesUri(info, uri) && verified.insert(p.CacheKey()).second) {
+                // The cached identity may be wrong: only this entry is read again from the device
+                cache.Erase(p.CacheKey());
+                info = GetPrinterInfo(p, cache, &cached);
+            }
+            if (!cached) {
+                verified.insert(p.CacheKey());
+            }
+            if (!matchesUri(info, uri)) {
+                continue;
+            }
+            // The key changes when the device is attached again (see UsbPrinter::CacheKey()),
+            // so a cached match needs no control transfer
+            p.Open();
+            Log::Debug() << "Device opened";
+            cache.Save();
+            return std::move(p);
+        }
+        cache.Save();
+        Log::Info() << "Waiting for printer to become available";
+        // Rescans as soon as a device is attached, the timeout covers devices that were not ready yet
+        backend.WaitForArrival(stopToken, arrivals, 5s);
+    }
+    return std::nullopt;
+}
+
+bool RunJob(StopToken stopToken, CaptPrinter& printer, std::string_view contentType, bool nativeRaster, int rasterFd) {
+    if (contentType == "application/vnd.cups-command") {
+        if (rasterFd >= 0 && rasterFd != STDIN_FILENO) {
+            close(rasterFd);
+        }
+        return printer.Clean(stopToken);
+    }
+    std::unique_ptr<RasterStreambuf> raster = OpenRaster(rasterFd, nativeRaster);
+    if (!raster) {
+        Log::Critical() << "Failed to open raster stream";
+        return false;
+    }
+    return printer.Print(stopToken, *raster);
+}
+
+void LogJobError(std::exception_ptr error) noexcept {
+    try {
+        std::rethrow_exception(error);
+    } catch (const Capt::UnexpectedBehaviourError& e) {
+        Log::Critical() << "Protocol fault: " << e.what();
+    } catch (const UsbError& e) {
+        Log::Critical() << "USB backend error: " << e.what() << " (" << e.StrErrcode() << ')';
+    } catch (const RasterError& e) {
+        Log::Critical() << "Raster error: " << e.what();
+    } catch (const std::exception& e) {
+        Log::Critical() << "Unhandled exception: " << e.what();
+    } catch (...) {
+        Log::Critical() << "Unhandled exception";
+    }
+}
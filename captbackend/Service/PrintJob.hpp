@@ -0,0 +1,31 @@
+#pragma once
+#include "Core/CaptPrinter.hpp"
+#include "Core/DeviceCache.hpp"
+#include "Core/PrinterInfo.hpp"
+#include "Core/RasterStreambuf.hpp"
+#include "Core/StopToken.hpp"
+#include "UsbBackend/UsbBackend.hpp"
+#include "UsbBackend/UsbPrinter.hpp"
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+// Steps of a job shared by the backend and the daemon (see Daemon.hpp)
+
+// Reads the identity from the cache, or from the device on a miss
+[[nodiscard]] std::optional<PrinterInfo> GetPrinterInfo(UsbPrinter& printer, DeviceCache& cache, bool* cached = nullptr);
+
+// Opens the printer with the given URI, waits for it to be attached.
+// Returns std::nullopt if stopped.
+[[nodiscard]] std::optional<UsbPrinter> ConnectByUri(StopToken stopToken, UsbBackend& backend, DeviceCache& cache, std::string_view uri);
+
+// Opens the raster read from fd (closed in any case), nullptr on failure
+[[nodiscard]] std::unique_ptr<RasterStreambuf> OpenRaster(int fd, bool nativeRaster);
+
+// Prints the raster read from rasterFd (closed in any case), or cleans the printer for a command job.
+// The unit must be reserved.
+bool RunJob(StopToken stopToken, CaptPrinter& printer, std::string_view contentType, bool nativeRaster, int rasterFd);
+
+// Logs an exception thrown by a job
+void LogJobError(std::exception_ptr error) noexcept;
@@ -0,0 +1,160 @@
+#include "Protocol.hpp"
+#include "Config.hpp"
+#include "Core/Log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static constexpr char RequestMagic[8] = {'C', 'A', 'P', 'T', 'J', 'O', 'B', '1'};
+static constexpr std::size_t MaxMessageSize = 64 * 1024;
+
+static void putString(std::vector<char>& buff, std::string_view str) {
+    uint32_t size = static_cast<uint32_t>(str.size());
+    buff.insert(buff.end(), reinterpret_cast<const char*>(&size), reinterpret_cast<const char*>(&size) + sizeof(size));
+    buff.insert(buff.end(), str.begin(), str.end());
+}
+
+static bool getString(std::string_view& data, std::string& str) {
+    uint32_t size;
+    if (data.size() < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, data.data(), sizeof(size));
+    data.remove_prefix(sizeof(size));
+    if (data.size() < size) {
+        return false;
+    }
+    str.assign(data.substr(0, size));
+    data.remove_prefix(size);
+    return true;
+}
+
+std::filesystem::path DaemonSocketPath(std::string_view stateDir) {
+    return std::filesystem::path(stateDir) / CAPTBACKEND_NAME / "daemon.sock";
+}
+
+bool SendRequest(int sock, const JobRequest& request, int rasterFd, int logFd) noexcept {
+    std::vector<char> buff;
+    try {
+        buff.assign(std::begin(RequestMagic), std::end(RequestMagic));
+        putString(buff, request.Uri);
+        putString(buff, request.ContentType);
+        putString(buff, request.Copies);
+        putString(buff, request.Options);
+        putString(buff, std::to_string(request.Linger));
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    if (buff.size() > MaxMessageSize) {
+        Log::Debug() << "Job request is too large";
+        return false;
+    }
+    int fds[2] = {logFd, rasterFd};
+    unsigned count = rasterFd >= 0 ? 2 : 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec iov{buff.data(), buff.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(buff.size())) {
+        Log::Debug() << "sendmsg() failed: " << std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+std::optional<JobRequest> ReceiveRequest(int sock, int& rasterFd, int& logFd) noexcept {
+    rasterFd = -1;
+    logFd = -1;
+    std::vector<char> buff;
+    try {
+        buff.resize(MaxMessageSize);
+    } catch (const std::bad_alloc&) {
+        return std::nullopt;
+    }
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    iovec iov{buff.data(), buff.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t size = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (size < 0) {
+        Log::Debug() << "recvmsg() failed: " << std::strerror(errno);
+        return std::nullopt;
+    }
+    unsigned received = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (std::size_t i = 0; i < count; i++) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+            // Only the log and the raster are used, whatever else was sent is closed
+            if (received == 0) {
+                logFd = fd;
+            } else if (received == 1) {
+                rasterFd = fd;
+            } else {
+                close(fd);
+            }
+            received++;
+        }
+    }
+
+    JobRequest request;
+    std::string linger;
+    std::string_view data(buff.data(), static_cast<std::size_t>(size));
+    bool ok = (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) == 0
+        && data.starts_with(std::string_view(RequestMagic, sizeof(RequestMagic)));
+    if (ok) {
+        data.remove_prefix(sizeof(RequestMagic));
+        try {
+            ok = getString(data, request.Uri) && getString(data, request.ContentType)
+                && getString(data, request.Copies) && getString(data, request.Options) && getString(data, linger);
+            request.Linger = ok ? static_cast<unsigned>(std::stoul(linger)) : 0;
+        } catch (const std::exception&) {
+            ok = false;
+        }
+    }
+    if (!ok || logFd < 0) {
+        Log::Debug() << "Invalid job request";
+        for (int fd : {rasterFd, logFd}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        rasterFd = -1;
+        logFd = -1;
+        return std::nullopt;
+    }
+    return request;
+}
+
+bool SendResult(int sock, int status) noexcept {
+    int32_t value = status;
+    return send(sock, &value, sizeof(value), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(value));
+}
+
+std::optional<int> ReceiveResult(int sock) noexcept {
+    int32_t value;
+    if (recv(sock, &value, sizeof(value), 0) != static_cast<ssize_t>(sizeof(value))) {
+        return std::nullopt;
+    }
+    return value;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Messages between the backend and the daemon over a SOCK_SEQPACKET Unix socket.
+// The backend sends a JobRequest with the raster and log file descriptors attached,
+// the daemon writes the job log straight to the log descriptor and answers with the exit status.
+// The backend shuts the socket down to cancel the job.
+struct JobRequest {
+    std::string Uri;
+    std::string ContentType;
+    std::string Copies;
+    std::string Options;
+    // Seconds the unit stays reserved after the job
+    unsigned Linger = 0;
+};
+
+// Socket of the daemon in the CUPS state directory
+[[nodiscard]] std::filesystem::path DaemonSocketPath(std::string_view stateDir);
+
+// rasterFd may be -1
+bool SendRequest(int sock, const JobRequest& request, int rasterFd, int logFd) noexcept;
+// The descriptors are -1 if missing, and owned by the caller
+[[nodiscard]] std::optional<JobRequest> ReceiveRequest(int sock, int& rasterFd, int& logFd) noexcept;
+
+// Result of a job the daemon did not start, the backend runs it by itself
+inline constexpr int JobRejected = -1;
+
+bool SendResult(int sock, int status) noexcept;
+[[nodiscard]] std::optional<int> ReceiveResult(int sock) noexcept;
@@ -1,11 +1,19 @@
 #include "UsbBackend.hpp"
+#include "Config.hpp"
 #include "Core/Log.hpp"
 #include "UsbError.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <concepts>
+#include <deque>
+#include <exception>
 #include <iomanip>
+#include <iterator>
 #include <libusb.h>
 #include <optional>
+#include <sys/time.h>
+#include <utility>
 
 using libusb_device_list = std::unique_ptr<libusb_device*, void(*)(libusb_device**)>;
 
@@ -19,6 +27,22 @@ static inline bool isPrinter(const libusb_interface_descriptor& alt) noexcept {
     return alt.bInterfaceClass == LIBUSB_CLASS_PRINTER && alt.bInterfaceSubClass == 1 && alt.bInterfaceProtocol == 2;
 }
 
+// Printers listed in dist/capt.usb-quirks and other Canon printers, other devices are not probed at all
+static inline bool isCandidate(const libusb_device_descriptor& desc) noexcept {
+    bool printerClass = desc.bDeviceClass == LIBUSB_CLASS_PER_INTERFACE || desc.bDeviceClass == LIBUSB_CLASS_PRINTER;
+    #if CAPTBACKEND_USB_ID_FILTER
+    static constexpr uint16_t canonVendorId = 0x04a9;
+    static constexpr std::pair<uint16_t, uint16_t> ids[] = {CAPTBACKEND_USB_IDS};
+    if (std::ranges::find(ids, std::pair(desc.idVendor, desc.idProduct)) != std::end(ids)) {
+        return true;
+    }
+    // Models missing from the list (e.g. LBP800), the device ID read by the probe tells CAPT printers apart
+    return desc.idVendor == canonVendorId && printerClass;
+    #else
+    return printerClass;
+    #endif
+}
+
 template<typename FuncT> requires requires(FuncT&& func, libusb_config_descriptor_ptr&& conf) {
     { func(std::move(conf)) } -> std::same_as<bool>;
 }
@@ -72,6 +96,31 @@ static std::optional<libusb_interface_descriptor> findPrinterAlt(libusb_config_d
 
 UsbBackend::UsbBackend() noexcept : context(nullptr, libusb_exit) {}
 
+UsbBackend::~UsbBackend() noexcept {
+    if (this->hotplug) {
+        libusb_hotplug_deregister_callback(this->context.get(), *this->hotplug);
+    }
+    if (this->events.joinable()) {
+        this->stopEvents = true;
+        #if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000105
+        libusb_interrupt_event_handler(this->context.get());
+        #endif
+        this->events.join();
+    }
+}
+
+void UsbBackend::handleEvents() noexcept {
+    while (!this->stopEvents) {
+        // Bounded, so that the thread notices stopEvents without libusb_interrupt_event_handler()
+        timeval tv{0, 200000};
+        int err = libusb_handle_events_timeout_completed(this->context.get(), &tv, nullptr);
+        if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_INTERRUPTED) {
+            Log::Debug() << "libusb_handle_events_timeout_completed failed: " << libusb_error_name(err);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
 void UsbBackend::Init() {
     libusb_context* ctx;
     #if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x0100010A
@@ -84,6 +133,63 @@ void UsbBackend::Init() {
         throw UsbError("init failed", err);
     }
     this->context.reset(ctx);
+    this->registerHotplug();
+    this->events = std::thread(&UsbBackend::handleEvents, this);
+}
+
+int LIBUSB_CALL UsbBackend::onHotplug(
+    [[maybe_unused]] libusb_context* ctx, libusb_device* dev,
+    [[maybe_unused]] libusb_hotplug_event event, void* userData
+) noexcept {
+    // Called on the event thread, the device is opened by the waiting thread
+    libusb_device_descriptor desc;
+    if (libusb_get_device_descriptor(dev, &desc) != LIBUSB_SUCCESS || !isCandidate(desc)) {
+        return 0;
+    }
+    UsbBackend& self = *static_cast<UsbBackend*>(userData);
+    {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.arrivals++;
+    }
+    self.cond.notify_all();
+    return 0;
+}
+
+void UsbBackend::registerHotplug() noexcept {
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        Log::Debug() << "Hotplug is not supported, polling for devices";
+        return;
+    }
+    // Only the descriptors are checked in the callback (see isCandidate)
+    libusb_hotplug_callback_handle handle;
+    int err = libusb_hotplug_register_callback(
+        this->context.get(), LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, LIBUSB_HOTPLUG_NO_FLAGS,
+        LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+        &UsbBackend::onHotplug, this, &handle
+    );
+    if (err != LIBUSB_SUCCESS) {
+        Log::Debug() << "libusb_hotplug_register_callback failed: " << libusb_error_name(err) << ", polling for devices";
+        return;
+    }
+    this->hotplug = handle;
+}
+
+unsigned long UsbBackend::Arrivals() noexcept {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->arrivals;
+}
+
+void UsbBackend::WaitForArrival(StopToken stopToken, unsigned long since, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!stopToken.stop_requested() && this->arrivals == since) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        // The fallback StopToken has no callbacks, so the wait is bounded
+        this->cond.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(100)));
+    }
 }
 
 std::vector<UsbPrinter> UsbBackend::GetPrinters() {
@@ -101,6 +207,9 @@ std::vector<UsbPrinter> UsbBackend::GetPrinters() {
             Log::Debug() << "libusb_get_device_descriptor failed: " << libusb_error_name(err) << ", skipping";
             continue;
         }
+        if (!isCandidate(desc)) {
+            continue;
+        }
 
         foreachConfigs(dev.get(), desc, [&](libusb_config_descriptor_ptr&& conf) {
             auto alt = findPrinterAlt(conf.get());
@@ -123,3 +232,89 @@ std::vector<UsbPrinter> UsbBackend::GetPrinters() {
     }
     return printers;
 }
+
+void UsbBackend::ProbePrinters(std::vector<UsbPrinter>& printers, unsigned threads, std::chrono::milliseconds timeout, std::chrono::steady_clock::time_point deadline, const ProbeReport& report) {
+    if (printers.empty()) {
+        return;
+    }
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::size_t next = 0;
+    unsigned running = 0;
+    std::deque<std::pair<std::size_t, std::optional<PrinterInfo>>> results;
+
+    auto probe = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next < printers.size() && std::chrono::steady_clock::now() < deadline) {
+            std::size_t i = next++;
+            lock.unlock();
+            std::optional<PrinterInfo> info;
+            try {
+                // The transfers end at the deadline at the latest, so the probes do not outlive it
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                info = printers[i].GetPrinterInfo(std::min(timeout, left));
+            } catch (const UsbError& e) {
+                Log::Debug() << "Failed to probe device " << std::hex << std::setfill('0')
+                    << std::setw(4) << printers[i].VendorId() << ':' << std::setw(4) << printers[i].ProductId()
+                    << " (" << e.what() << "), skipping";
+            }
+            lock.lock();
+            results.emplace_back(i, std::move(info));
+            cond.notify_all();
+        }
+        running--;
+        cond.notify_all();
+    };
+
+    // A wedged device holds up one thread for the timeout instead of the whole scan
+    threads = static_cast<unsigned>(std::min<std::size_t>(std::max(threads, 1u), printers.size()));
+    running = threads;
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; i++) {
+        pool.emplace_back(probe);
+    }
+    std::exception_ptr error;
+    std::size_t skipped = 0;
+    std::size_t late = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        bool ready = cond.wait_until(lock, deadline, [&] {
+            return !results.empty() || running == 0;
+        });
+        if (!ready) {
+            // The running probes end with their transfers, their results are not reported
+            late = running;
+            skipped = printers.size() - next;
+            next = printers.size();
+            break;
+        }
+        if (results.empty()) {
+            break;
+        }
+        auto [i, info] = std::move(results.front());
+        results.pop_front();
+        lock.unlock();
+        try {
+            report(printers[i], std::move(info));
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error) {
+            // Devices being probed are still waited for
+            skipped = printers.size() - next;
+            next = printers.size();
+            break;
+        }
+    }
+    lock.unlock();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (skipped != 0 || late != 0) {
+        Log::Debug() << "Probe deadline reached, " << skipped << " devices skipped, " << late << " not reported";
+    }
+}
@@ -1,16 +1,52 @@
 #pragma once
 #include "UsbPrinter.hpp"
+#include "Core/StopToken.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <libusb.h>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <vector>
 
 using libusb_context_ptr = std::unique_ptr<libusb_context, decltype(&libusb_exit)>;
 
 class UsbBackend {
+public:
+    using ProbeReport = std::function<void(UsbPrinter& printer, std::optional<PrinterInfo> info)>;
 private:
     libusb_context_ptr context;
+    std::atomic<bool> stopEvents = false;
+    std::thread events;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::optional<libusb_hotplug_callback_handle> hotplug;
+    unsigned long arrivals = 0;
+
+    void handleEvents() noexcept;
+    void registerHotplug() noexcept;
+    static int LIBUSB_CALL onHotplug(libusb_context* ctx, libusb_device* dev, libusb_hotplug_event event, void* userData) noexcept;
 public:
     UsbBackend() noexcept;
+    ~UsbBackend() noexcept;
 
+    UsbBackend(const UsbBackend&) = delete;
+    UsbBackend& operator=(const UsbBackend&) = delete;
+
+    // Also starts the thread completing asynchronous transfers (see UsbStreambuf)
     void Init();
     [[nodiscard]] std::vector<UsbPrinter> GetPrinters();
+    // Reads the printer info of the devices on up to `threads` threads, a device takes at most `timeout`.
+    // Report is called on the calling thread as soon as a device is probed, failed devices get std::nullopt.
+    // Returns at the deadline: the transfers end there, devices not probed by then are not reported.
+    void ProbePrinters(std::vector<UsbPrinter>& printers, unsigned threads, std::chrono::milliseconds timeout, std::chrono::steady_clock::time_point deadline, const ProbeReport& report);
+
+    // Number of devices attached so far, taken before GetPrinters() to not miss a device
+    [[nodiscard]] unsigned long Arrivals() noexcept;
+    // Returns when a device is attached after the given Arrivals() value, or after timeout.
+    // Without hotplug support it always waits for the timeout.
+    void WaitForArrival(StopToken stopToken, unsigned long since, std::chrono::milliseconds timeout);
 };
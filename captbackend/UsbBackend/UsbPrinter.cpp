@@ -1,9 +1,13 @@
 #include "UsbPrinter.hpp"
 #include "Core/Log.hpp"
 #include "UsbError.hpp"
+#include <algorithm>
+#include <chrono>
 #include <iomanip>
 #include <libusb.h>
 #include <cassert>
+#include <cstdio>
+#include <optional>
 
 UsbPrinter::UsbPrinter(
     libusb_device_ptr dev,
@@ -19,7 +23,7 @@ UsbPrinter::~UsbPrinter() noexcept {
     }
 }
 
-int UsbPrinter::open() noexcept {
+int UsbPrinter::open(bool reset) noexcept {
     if (this->handle.get() != nullptr) {
         return LIBUSB_SUCCESS;
     }
@@ -29,7 +33,9 @@ int UsbPrinter::open() noexcept {
         Log::Debug() << "libusb_open failed: " << libusb_error_name(err);
     } else {
         this->handle.reset(handle);
-        this->reset();
+        if (reset) {
+            this->reset();
+        }
     }
     return err;
 }
@@ -95,7 +101,7 @@ void UsbPrinter::setAltSetting() {
 }
 
 void UsbPrinter::Open() {
-    int err = this->open();
+    int err = this->open(true);
     if (err != LIBUSB_SUCCESS) {
         throw UsbError("failed to open device", err);
     }
@@ -153,25 +159,65 @@ void UsbPrinter::reset() noexcept {
     }
 }
 
-std::string UsbPrinter::getStringDescriptor(uint8_t idx) {
+// Time left for a control transfer, libusb waits forever with 0
+static std::optional<unsigned> transferTimeout(std::chrono::steady_clock::time_point deadline) noexcept {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+        return std::nullopt;
+    }
+    return static_cast<unsigned>(left.count());
+}
+
+// Same as libusb_get_string_descriptor_ascii(), which has a fixed timeout
+std::string UsbPrinter::getStringDescriptor(uint8_t idx, std::chrono::steady_clock::time_point deadline) {
     assert(this->handle.get() != nullptr);
-    unsigned char buffer[256];
-    int length = libusb_get_string_descriptor_ascii(this->handle.get(), idx, buffer, sizeof(buffer));
-    if (length < 0) {
-        Log::Debug() << "libusb_get_string_descriptor_ascii failed: " << libusb_error_name(length);
+    if (idx == 0) {
+        return "";
+    }
+    unsigned char buffer[255];
+    auto get = [&](uint8_t index, uint16_t langId) {
+        std::optional<unsigned> timeout = transferTimeout(deadline);
+        if (!timeout) {
+            return static_cast<int>(LIBUSB_ERROR_TIMEOUT);
+        }
+        return libusb_control_transfer(
+            this->handle.get(), LIBUSB_ENDPOINT_IN, LIBUSB_REQUEST_GET_DESCRIPTOR,
+            static_cast<uint16_t>((LIBUSB_DT_STRING << 8) | index), langId, buffer, sizeof(buffer), *timeout
+        );
+    };
+    // The first language is used
+    int length = get(0, 0);
+    if (length < 4) {
+        Log::Debug() << "Failed to get string descriptor languages: " << libusb_error_name(std::min(length, 0));
         return "";
     }
-    return std::string(reinterpret_cast<char*>(buffer), length);
+    uint16_t langId = static_cast<uint16_t>(buffer[2] | (buffer[3] << 8));
+    length = get(idx, langId);
+    if (length < 2 || buffer[1] != LIBUSB_DT_STRING || buffer[0] > length) {
+        Log::Debug() << "Failed to get string descriptor " << static_cast<int>(idx) << ": " << libusb_error_name(std::min(length, 0));
+        return "";
+    }
+    // UTF-16LE, other than ASCII becomes '?'
+    std::string res;
+    for (int i = 2; i + 1 < buffer[0]; i += 2) {
+        res.push_back(buffer[i + 1] != 0 ? '?' : static_cast<char>(buffer[i]));
+    }
+    return res;
 }
 
-std::string UsbPrinter::getDeviceId() {
+std::string UsbPrinter::getDeviceId(std::chrono::steady_clock::time_point deadline) {
     assert(this->handle.get() != nullptr);
+    std::optional<unsigned> timeout = transferTimeout(deadline);
+    if (!timeout) {
+        throw UsbError("timed out getting 1284DeviceID", LIBUSB_ERROR_TIMEOUT);
+    }
     unsigned char buff[1024];
     int err = libusb_control_transfer(
         this->handle.get(),
         static_cast<uint8_t>(LIBUSB_REQUEST_TYPE_CLASS) | LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_INTERFACE,
         0, this->config->bConfigurationValue,
-        (static_cast<uint16_t>(this->alt.bInterfaceNumber) << 8) | this->alt.bAlternateSetting, buff, sizeof(buff), 5000
+        (static_cast<uint16_t>(this->alt.bInterfaceNumber) << 8) | this->alt.bAlternateSetting, buff, sizeof(buff),
+        *timeout
     );
     if (err < 0) {
         Log::Debug() << "libusb_control_transfer failed: " << libusb_error_name(err);
@@ -185,10 +231,26 @@ std::string UsbPrinter::getDeviceId() {
     return std::string(reinterpret_cast<char*>(buff+2), length-2);
 }
 
-std::optional<PrinterInfo> UsbPrinter::GetPrinterInfo() {
+std::string UsbPrinter::CacheKey() const {
+    uint8_t ports[7];
+    int count = libusb_get_port_numbers(this->dev.get(), ports, sizeof(ports));
+    char buff[128];
+    int length = std::snprintf(buff, sizeof(buff), "%03u", static_cast<unsigned>(libusb_get_bus_number(this->dev.get())));
+    for (int i = 0; i < count; i++) {
+        length += std::snprintf(buff + length, sizeof(buff) - length, "%c%u", i == 0 ? '-' : '.', static_cast<unsigned>(ports[i]));
+    }
+    std::snprintf(buff + length, sizeof(buff) - length, "@%03u %04x:%04x:%04x:%u",
+        static_cast<unsigned>(libusb_get_device_address(this->dev.get())),
+        static_cast<unsigned>(this->desc.idVendor), static_cast<unsigned>(this->desc.idProduct),
+        static_cast<unsigned>(this->desc.bcdDevice), static_cast<unsigned>(this->desc.iSerialNumber));
+    return buff;
+}
+
+std::optional<PrinterInfo> UsbPrinter::GetPrinterInfo(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
     bool opened = this->handle.get() == nullptr;
     if (opened) {
-        int err = this->open();
+        int err = this->open(false);
         if (err != LIBUSB_SUCCESS) {
             Log::Debug() << "Failed to open device " << std::hex << std::setfill('0')
                 << std::setw(4) << this->VendorId() << ':' << std::setw(4) << this->ProductId()
@@ -196,8 +258,8 @@ std::optional<PrinterInfo> UsbPrinter::GetPrinterInfo() {
             return std::nullopt;
         }
     }
-    std::string serial = this->getStringDescriptor(this->desc.iSerialNumber);
-    PrinterInfo info = PrinterInfo::Parse(this->getDeviceId(), std::move(serial));
+    std::string serial = this->getStringDescriptor(this->desc.iSerialNumber, deadline);
+    PrinterInfo info = PrinterInfo::Parse(this->getDeviceId(deadline), std::move(serial));
     if (opened) {
         this->Close();
     }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Core/PrinterInfo.hpp"
+#include <chrono>
 #include <libusb.h>
 #include <memory>
 #include <string>
@@ -24,7 +25,8 @@ private:
     bool kernelDriverDetached = false;
     bool interfaceClaimed = false;
 
-    int open() noexcept;
+    // Reset is skipped when only the descriptors and the device id are read
+    int open(bool reset) noexcept;
     void claim();
     void detachKernelDriver();
     void reset() noexcept;
@@ -33,8 +35,9 @@ private:
     void setConfig();
     void setAltSetting();
 
-    std::string getStringDescriptor(uint8_t idx);
-    std::string getDeviceId();
+    // The control transfers end at the deadline
+    std::string getStringDescriptor(uint8_t idx, std::chrono::steady_clock::time_point deadline);
+    std::string getDeviceId(std::chrono::steady_clock::time_point deadline);
 public:
     explicit UsbPrinter(
         libusb_device_ptr dev,
@@ -58,5 +61,9 @@ public:
     void Open();
     void Close() noexcept;
 
-    [[nodiscard]] std::optional<PrinterInfo> GetPrinterInfo();
+    // Port path, address and descriptor fields, changes when the device is reattached.
+    // Read without control transfers (see DeviceCache).
+    [[nodiscard]] std::string CacheKey() const;
+    // The timeout applies to all the control transfers together
+    [[nodiscard]] std::optional<PrinterInfo> GetPrinterInfo(std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
 };
@@ -5,14 +5,196 @@
 #include <cstddef>
 #include <cstring>
 #include <libusb.h>
+#include <utility>
 
 using int_type = UsbStreambuf::int_type;
 
-UsbStreambuf::UsbStreambuf(UsbPrinter& printer, std::size_t wbuffSize, unsigned timeoutMs)
-    : printer(printer), rbuff(1024), wbuff(wbuffSize), timeoutMs(timeoutMs) {
-    char_type* wstart = this->wbuff.data();
-    char_type* wend = wstart + this->wbuff.size() - 1;
-    this->setp(wstart, wend);
+static int transferError(libusb_transfer_status status) noexcept {
+    switch (status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+        return LIBUSB_SUCCESS;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+        return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_CANCELLED:
+        return LIBUSB_ERROR_INTERRUPTED;
+    case LIBUSB_TRANSFER_STALL:
+        return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+        return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+        return LIBUSB_ERROR_OVERFLOW;
+    default:
+        return LIBUSB_ERROR_IO;
+    }
+}
+
+UsbStreambuf::UsbStreambuf(UsbPrinter& printer, unsigned transfers, std::size_t wbuffSize, unsigned timeoutMs)
+    : printer(printer), rbuff(1024), wbuffSize(wbuffSize), timeoutMs(timeoutMs) {
+    assert(this->printer.handle.get() != nullptr);
+    if (transfers == 0) {
+        this->wbuff.resize(wbuffSize);
+        this->resetPut();
+        return;
+    }
+    this->transfers.reserve(transfers);
+    unsigned devMem = 0;
+    for (unsigned i = 0; i < transfers; i++) {
+        Transfer t{this, libusb_alloc_transfer(0), nullptr, false, false};
+        if (t.Handle == nullptr) {
+            this->freeTransfers();
+            throw UsbError("failed to allocate transfer", LIBUSB_ERROR_NO_MEM);
+        }
+        #if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000105
+        // Zero-copy buffers mapped from usbfs, not available on every platform and kernel
+        t.Buffer = libusb_dev_mem_alloc(this->printer.handle.get(), wbuffSize);
+        t.DevMem = t.Buffer != nullptr;
+        #endif
+        if (t.Buffer == nullptr) {
+            t.Buffer = new unsigned char[wbuffSize];
+        }
+        devMem += t.DevMem ? 1 : 0;
+        this->transfers.push_back(t);
+    }
+    Log::Debug() << "USB writes: " << transfers << " transfers of " << wbuffSize << " bytes, "
+        << devMem << " in device memory";
+    this->resetPut();
+}
+
+UsbStreambuf::~UsbStreambuf() noexcept {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for (Transfer& t : this->transfers) {
+        if (t.Busy) {
+            libusb_cancel_transfer(t.Handle);
+        }
+    }
+    // Callbacks must not run after the transfers are freed
+    this->cond.wait(lock, [this] {
+        return this->inFlight == 0;
+    });
+    lock.unlock();
+    this->freeTransfers();
+    if (this->bytesSent != 0) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(this->busyTime).count();
+        Log::Debug() << "USB writes: " << (this->bytesSent / 1024) << " KiB in " << ms << " ms on the bus ("
+            << (ms == 0 ? 0 : this->bytesSent / static_cast<std::size_t>(ms)) << " KB/s)";
+    }
+}
+
+void UsbStreambuf::freeTransfers() noexcept {
+    for (Transfer& t : this->transfers) {
+        libusb_free_transfer(t.Handle);
+        if (t.DevMem) {
+            #if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000105
+            libusb_dev_mem_free(this->printer.handle.get(), t.Buffer, this->wbuffSize);
+            #endif
+        } else {
+            delete[] t.Buffer;
+        }
+    }
+    this->transfers.clear();
+}
+
+void UsbStreambuf::resetPut() noexcept {
+    char_type* start = this->transfers.empty()
+        ? this->wbuff.data()
+        : reinterpret_cast<char_type*>(this->transfers[this->current].Buffer);
+    // One byte is kept for the character passed to overflow()
+    this->setp(start, start + this->wbuffSize - 1);
+}
+
+void LIBUSB_CALL UsbStreambuf::onTransfer(libusb_transfer* transfer) noexcept {
+    Transfer& t = *static_cast<Transfer*>(transfer->user_data);
+    UsbStreambuf& self = *t.Owner;
+    std::lock_guard<std::mutex> lock(self.mutex);
+    int err = transferError(transfer->status);
+    if (err == LIBUSB_SUCCESS && transfer->actual_length != transfer->length) {
+        err = LIBUSB_ERROR_IO;
+    }
+    if (err != LIBUSB_SUCCESS && self.error == LIBUSB_SUCCESS) {
+        self.error = err;
+    }
+    self.bytesSent += static_cast<std::size_t>(transfer->actual_length);
+    t.Busy = false;
+    if (--self.inFlight == 0) {
+        self.busyTime += std::chrono::steady_clock::now() - self.busySince;
+    }
+    self.cond.notify_all();
+}
+
+void UsbStreambuf::submit() {
+    std::ptrdiff_t count = this->pptr() - this->pbase();
+    if (count == 0) {
+        return;
+    }
+    Transfer& t = this->transfers[this->current];
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // The timeout runs from the submission, while the transfers ahead are still on the bus
+    libusb_fill_bulk_transfer(
+        t.Handle, this->printer.handle.get(), this->printer.writeEp,
+        t.Buffer, static_cast<int>(count), &UsbStreambuf::onTransfer, &t,
+        this->timeoutMs * (this->inFlight + 1)
+    );
+    int err = libusb_submit_transfer(t.Handle);
+    if (err != LIBUSB_SUCCESS) {
+        Log::Debug() << "UsbStreambuf::submit(): libusb_submit_transfer failed: " << libusb_error_name(err);
+        throw UsbError("write failed", err);
+    }
+    t.Busy = true;
+    if (!this->firstWrite) {
+        this->firstWrite = std::chrono::steady_clock::now();
+    }
+    if (this->inFlight++ == 0) {
+        this->busySince = std::chrono::steady_clock::now();
+    }
+    this->current = (this->current + 1) % this->transfers.size();
+}
+
+// Waits until the current buffer (or every buffer) is free and reports transfer errors
+void UsbStreambuf::wait(std::unique_lock<std::mutex>& lock, bool all) {
+    this->cond.wait(lock, [this, all] {
+        return all ? this->inFlight == 0 : (!this->transfers[this->current].Busy || this->error != LIBUSB_SUCCESS);
+    });
+    if (this->error == LIBUSB_SUCCESS) {
+        return;
+    }
+    // The data after a failed transfer is useless to the printer
+    for (Transfer& t : this->transfers) {
+        if (t.Busy) {
+            libusb_cancel_transfer(t.Handle);
+        }
+    }
+    this->cond.wait(lock, [this] {
+        return this->inFlight == 0;
+    });
+    int err = std::exchange(this->error, LIBUSB_SUCCESS);
+    Log::Debug() << "UsbStreambuf: bulk transfer failed: " << libusb_error_name(err);
+    throw UsbError("write failed", err);
+}
+
+void UsbStreambuf::writeSync() {
+    std::ptrdiff_t count = this->pptr() - this->pbase();
+    char_type* data = this->pbase();
+    auto start = std::chrono::steady_clock::now();
+    if (count > 0 && !this->firstWrite) {
+        this->firstWrite = start;
+    }
+    while (count > 0) {
+        int transferred;
+        int err = libusb_bulk_transfer(
+            this->printer.handle.get(), this->printer.writeEp,
+            reinterpret_cast<unsigned char*>(data), count, &transferred,
+            this->timeoutMs
+        );
+        if (err != LIBUSB_SUCCESS) {
+            Log::Debug() << "UsbStreambuf::sync(): libusb_bulk_transfer failed: " << libusb_error_name(err);
+            throw UsbError("write failed", err);
+        }
+        assert(transferred >= 0 && transferred <= count);
+        count -= transferred;
+        data += transferred;
+        this->bytesSent += static_cast<std::size_t>(transferred);
+    }
+    this->busyTime += std::chrono::steady_clock::now() - start;
 }
 
 int_type UsbStreambuf::overflow(int_type c) {
@@ -20,7 +202,22 @@ int_type UsbStreambuf::overflow(int_type c) {
         *this->pptr() = traits_type::to_char_type(c);
         this->pbump(1);
     }
-    return this->sync() == 0 ? traits_type::not_eof(c) : traits_type::eof();
+    try {
+        if (this->transfers.empty()) {
+            this->writeSync();
+        } else {
+            // The buffer goes out in the background while the next one is filled
+            this->submit();
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wait(lock, false);
+        }
+    } catch (...) {
+        // The streambuf outlives the job in the daemon, the next one must not send these bytes
+        this->resetPut();
+        throw;
+    }
+    this->resetPut();
+    return traits_type::not_eof(c);
 }
 
 int_type UsbStreambuf::underflow() {
@@ -41,31 +238,24 @@ int_type UsbStreambuf::underflow() {
         throw UsbError("read failed", err);
     }
     assert(transferred >= 0);
-    Log::Debug() << "Received " << transferred << " bytes from device";
     this->setg(start, start, start + transferred);
     return traits_type::to_int_type(*this->gptr());
 }
 
 int UsbStreambuf::sync() {
     assert(this->printer.handle.get() != nullptr);
-    std::ptrdiff_t count = this->pptr() - this->pbase();
-
-    while (count > 0) {
-        int transferred;
-        int err = libusb_bulk_transfer(
-            this->printer.handle.get(), this->printer.writeEp,
-            reinterpret_cast<unsigned char*>(this->pbase()), count, &transferred,
-            this->timeoutMs
-        );
-        if (err != LIBUSB_SUCCESS) {
-            Log::Debug() << "UsbStreambuf::sync(): libusb_bulk_transfer failed: " << libusb_error_name(err);
-            throw UsbError("write failed", err);
+    try {
+        if (this->transfers.empty()) {
+            this->writeSync();
+        } else {
+            this->submit();
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wait(lock, true);
         }
-        assert(transferred >= 0 && transferred <= count);
-        Log::Debug() << "Sent " << transferred << " bytes to device";
-        count -= transferred;
+    } catch (...) {
+        this->resetPut();
+        throw;
     }
-
-    this->setp(this->pbase(), this->epptr());
+    this->resetPut();
     return 0;
 }
@@ -1,15 +1,44 @@
 #pragma once
 #include "UsbPrinter.hpp"
+#include "Config.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
 #include <streambuf>
 #include <libusb.h>
 #include <vector>
 
+// Writes go out as asynchronous bulk transfers from a ring of buffers, so that the next buffer
+// is filled while the previous ones are on the bus. sync() waits until everything has been sent.
+// Completions are delivered by the UsbBackend event thread.
 class UsbStreambuf : public std::streambuf {
 private:
+    struct Transfer {
+        UsbStreambuf* Owner;
+        libusb_transfer* Handle;
+        unsigned char* Buffer;
+        bool DevMem;
+        bool Busy;
+    };
+
     UsbPrinter& printer;
 
     std::vector<char_type> rbuff;
     std::vector<char_type> wbuff;
+    std::size_t wbuffSize;
+    std::vector<Transfer> transfers;
+    std::size_t current = 0;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned inFlight = 0;
+    int error = LIBUSB_SUCCESS;
+    std::size_t bytesSent = 0;
+    std::chrono::steady_clock::duration busyTime{};
+    std::chrono::steady_clock::time_point busySince;
+    std::optional<std::chrono::steady_clock::time_point> firstWrite;
 
     unsigned timeoutMs;
 
@@ -17,6 +46,23 @@ private:
     int_type underflow() override;
 
     int sync() override;
+
+    static void LIBUSB_CALL onTransfer(libusb_transfer* transfer) noexcept;
+    void submit();
+    void wait(std::unique_lock<std::mutex>& lock, bool all);
+    void writeSync();
+    void freeTransfers() noexcept;
+    void resetPut() noexcept;
 public:
-    explicit UsbStreambuf(UsbPrinter& printer, std::size_t wbuffSize = 65535, unsigned timeoutMs = 5000);
+    // transfers == 0 writes synchronously with libusb_bulk_transfer()
+    explicit UsbStreambuf(UsbPrinter& printer, unsigned transfers = CAPTBACKEND_USB_TRANSFERS, std::size_t wbuffSize = 65535, unsigned timeoutMs = 5000);
+    ~UsbStreambuf() noexcept override;
+
+    UsbStreambuf(const UsbStreambuf&) = delete;
+    UsbStreambuf& operator=(const UsbStreambuf&) = delete;
+
+    // When the first bytes were handed to libusb, if any
+    [[nodiscard]] std::optional<std::chrono::steady_clock::time_point> FirstWrite() const noexcept {
+        return this->firstWrite;
+    }
 };
@@ -1,33 +1,44 @@
 #include "Core/BufferedWriter.hpp"
-#include "Core/RasterError.hpp"
 #include "Core/StateReporter.hpp"
 #include "Core/CaptPrinter.hpp"
+#include "Core/DeviceCache.hpp"
 #include "Core/Log.hpp"
 #include "Core/PrinterInfo.hpp"
 #include "Core/StopToken.hpp"
-#include "Cups/CupsRasterStreambuf.hpp"
+#include "Cups/CupsOptions.hpp"
+#include "Service/Client.hpp"
+#include "Service/Daemon.hpp"
+#include "Service/DaemonConfig.hpp"
+#include "Service/PrintJob.hpp"
 #include "UsbBackend/UsbBackend.hpp"
-#include "UsbBackend/UsbError.hpp"
 #include "UsbBackend/UsbPrinter.hpp"
 #include "UsbBackend/UsbStreambuf.hpp"
 #include "Config.hpp"
-#include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <csignal>
 #include <cstring>
 #include <exception>
+#include <fcntl.h>
+#include <filesystem>
 #include <iostream>
 #include <optional>
 #include <cups/backend.h>
-#include <libcapt/UnexpectedBehaviourError.hpp>
 #include <libcapt/Config.hpp>
+#include <string>
 #include <string_view>
-#include <thread>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 using namespace std::literals::chrono_literals;
 
 static StopSource stopSource;
 
+static constexpr unsigned ProbeThreads = 4;
+static constexpr auto ProbeTimeout = 2000ms;
+static constexpr auto DiscoveryTimeout = 5000ms;
+
 static void sighandler([[maybe_unused]] int sig) noexcept {
     stopSource.request_stop();
 }
@@ -37,41 +48,86 @@ static inline std::optional<std::string_view> getEnv(const char* key) noexcept {
     return val == nullptr ? std::nullopt : std::optional(std::string_view(val));
 }
 
-static std::optional<UsbPrinter> connectByUri(StopToken stopToken, UsbBackend& backend, std::string_view uri) {
-    while (!stopToken.stop_requested()) {
-        std::vector<UsbPrinter> printers = backend.GetPrinters();
-        for (UsbPrinter& p : printers) {
-            auto info = p.GetPrinterInfo();
-            if (!info || !info->IsCaptPrinter()) {
-                continue;
-            }
-            if (info->HasUri(uri)) {
-                return std::move(p);
-            }
+static void reportPrinter(const PrinterInfo& info) {
+    if (!info.IsCaptPrinter()) {
+        Log::Debug() << "Skipping non-CAPT v1 printer (" << info.DeviceId << ')';
+        return;
+    }
+    // CUPS lists the devices as they are reported
+    info.Report(std::cout) << std::endl;
+}
+
+// Socket passed by the service manager (sd_listen_fds protocol), or -1
+static int activationSocket() noexcept {
+    auto pid = getEnv("LISTEN_PID");
+    auto fds = getEnv("LISTEN_FDS");
+    if (!pid || !fds || std::to_string(getpid()) != *pid || *fds != "1") {
+        return -1;
+    }
+    constexpr int ListenFdsStart = 3;
+    fcntl(ListenFdsStart, F_SETFD, FD_CLOEXEC);
+    return ListenFdsStart;
+}
+
+static int runDaemon(StopToken stopToken, const char* socketPath) {
+    auto stateDir = getEnv("CUPS_STATEDIR");
+    std::filesystem::path cachePath;
+    if (stateDir) {
+        cachePath = std::filesystem::path(*stateDir) / CAPTBACKEND_NAME / "devices";
+    }
+    std::filesystem::path pageCacheDir;
+    if (auto cacheDir = getEnv("CUPS_CACHEDIR")) {
+        pageCacheDir = std::filesystem::path(*cacheDir) / CAPTBACKEND_NAME;
+    }
+
+    UsbBackend backend;
+    backend.Init();
+    DeviceCache deviceCache(cachePath);
+    DaemonConfig config = DaemonConfig::Load(std::filesystem::path(getEnv("CUPS_SERVERROOT").value_or("/etc/cups")) / CAPTBACKEND_NAME ".conf");
+    Daemon daemon(backend, deviceCache, pageCacheDir, std::chrono::seconds(CAPTBACKEND_DAEMON_LINGER), std::move(config), CAPTBACKEND_ENCODER_THREADS);
+    if (int fd = activationSocket(); fd >= 0) {
+        daemon.Adopt(fd);
+    } else if (socketPath != nullptr) {
+        if (!daemon.Listen(socketPath)) {
+            return CUPS_BACKEND_FAILED;
         }
-        Log::Info() << "Waiting for printer to become available";
-        std::this_thread::sleep_for(5s);
+    } else if (stateDir) {
+        if (!daemon.Listen(DaemonSocketPath(*stateDir))) {
+            return CUPS_BACKEND_FAILED;
+        }
+    } else {
+        Log::Critical() << "No socket to listen on";
+        return CUPS_BACKEND_FAILED;
     }
-    return std::nullopt;
+    daemon.Run(stopToken);
+    return CUPS_BACKEND_OK;
 }
 
-static void discover(UsbBackend& backend) {
+static void discover(UsbBackend& backend, DeviceCache& cache) {
     std::vector<UsbPrinter> printers = backend.GetPrinters();
     Log::Debug() << "Discovered " << printers.size() << " printer devices";
+    std::vector<UsbPrinter> unknown;
     for (UsbPrinter& p : printers) {
-        auto info = p.GetPrinterInfo();
-        if (!info) {
-            continue;
-        }
-        if (!info->IsCaptPrinter()) {
-            Log::Debug() << "Skipping non-CAPT v1 printer (" << info->DeviceId << ')';
-            continue;
+        if (auto info = cache.Find(p.CacheKey())) {
+            reportPrinter(*info);
+        } else {
+            unknown.push_back(std::move(p));
         }
-        info->Report(std::cout) << '\n';
     }
+    auto deadline = std::chrono::steady_clock::now() + DiscoveryTimeout;
+    backend.ProbePrinters(unknown, ProbeThreads, ProbeTimeout, deadline, [&](UsbPrinter& p, std::optional<PrinterInfo> info) {
+        if (info) {
+            cache.Insert(p.CacheKey(), *info);
+            reportPrinter(*info);
+        }
+    });
+    // All attached devices have been looked up, the rest are gone
+    cache.Prune();
+    cache.Save();
 }
 
 int main(int argc, const char* argv[]) {
+    auto startTime = std::chrono::steady_clock::now();
     std::signal(SIGPIPE, SIG_IGN);
     std::signal(SIGTERM, sighandler);
     std::signal(SIGINT, sighandler);
@@ -83,8 +139,22 @@ int main(int argc, const char* argv[]) {
         return CUPS_BACKEND_OK;
     }
 
+    if (argc >= 2 && argc <= 3 && std::strcmp(argv[1], "--daemon") == 0) {
+        char logBuff[1024];
+        BufferedWriter writer(std::cerr, logBuff);
+        std::ostream logStream(&writer);
+        Log::SetLogStream(logStream);
+        try {
+            return runDaemon(stopToken, argc == 3 ? argv[2] : nullptr);
+        } catch (...) {
+            LogJobError(std::current_exception());
+        }
+        return CUPS_BACKEND_FAILED;
+    }
+
     if (argc != 1 && argc != 6 && argc != 7) {
         std::cout << "Usage: " << argv[0] << " job-id user title copies options [file]" << '\n';
+        std::cout << "       " << argv[0] << " --daemon [socket]" << '\n';
         return CUPS_BACKEND_FAILED;
     }
 
@@ -99,10 +169,17 @@ int main(int argc, const char* argv[]) {
     try {
         StateReporter reporter(logStream);
         UsbBackend backend;
-        backend.Init();
+
+        std::filesystem::path cachePath;
+        auto stateDir = getEnv("CUPS_STATEDIR");
+        if (stateDir) {
+            cachePath = std::filesystem::path(*stateDir) / CAPTBACKEND_NAME / "devices";
+        }
 
         if (argc == 1) {
-            discover(backend);
+            backend.Init();
+            DeviceCache deviceCache(cachePath);
+            discover(backend, deviceCache);
             return CUPS_BACKEND_OK;
         }
 
@@ -124,8 +201,42 @@ int main(int argc, const char* argv[]) {
             }
         }
 
+        PrintOptions options = ParsePrintOptions(argv[4], argv[5]);
+        if (auto cacheDir = getEnv("CUPS_CACHEDIR")) {
+            options.PageCacheDir = std::filesystem::path(*cacheDir) / CAPTBACKEND_NAME;
+        }
+
+        int rasterFd = STDIN_FILENO;
+        if (argc == 7) {
+            rasterFd = open(argv[6], O_RDONLY | O_CLOEXEC);
+            if (rasterFd < 0) {
+                Log::Critical() << "Failed to open " << argv[6] << ": " << std::strerror(errno);
+                return CUPS_BACKEND_FAILED;
+            }
+        }
+
+        if (options.Daemon && stateDir) {
+            JobRequest request{
+                .Uri = std::string(*targetUri),
+                .ContentType = std::string(*contentType),
+                .Copies = argv[4],
+                .Options = argv[5],
+                .Linger = options.DaemonLinger,
+            };
+            logStream.flush();
+            if (auto status = RunInDaemon(stopToken, DaemonSocketPath(*stateDir), request, rasterFd)) {
+                if (rasterFd != STDIN_FILENO) {
+                    close(rasterFd);
+                }
+                return *status;
+            }
+            Log::Debug() << "Daemon is not available, printing directly";
+        }
+
+        backend.Init();
+        DeviceCache deviceCache(cachePath);
         reporter.SetReason("connecting-to-device", true);
-        std::optional<UsbPrinter> targetPrinter = connectByUri(stopToken, backend, *targetUri);
+        std::optional<UsbPrinter> targetPrinter = ConnectByUri(stopToken, backend, deviceCache, *targetUri);
         reporter.SetReason("connecting-to-device", false);
         if (stopToken.stop_requested()) {
             return CUPS_BACKEND_OK;
@@ -134,43 +245,28 @@ int main(int argc, const char* argv[]) {
             Log::Critical() << "Device not found";
             return CUPS_BACKEND_FAILED;
         }
-        targetPrinter->Open();
-        Log::Debug() << "Device opened";
 
-        UsbStreambuf streambuf(*targetPrinter);
+        UsbStreambuf streambuf(*targetPrinter, options.UsbTransfers);
         std::iostream printerStream(&streambuf);
         printerStream.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
-        CaptPrinter printer(printerStream, reporter);
+        CaptPrinter printer(printerStream, reporter, options);
         printer.ReserveUnit();
         Log::Info() << "Unit reserved";
-
-        bool success;
-        if (*contentType == "application/vnd.cups-command") {
-            success = printer.Clean(stopToken);
-        } else {
-            assert(*contentType == "application/vnd.cups-raster");
-            CupsRasterStreambuf cupsRaster;
-            if (!cupsRaster.Open(argc == 7 ? argv[6] : nullptr)) {
-                Log::Critical() << "Failed to open raster stream";
-                return CUPS_BACKEND_FAILED;
-            }
-            success = printer.Print(stopToken, cupsRaster);
+        if (auto firstWrite = streambuf.FirstWrite()) {
+            Log::Debug() << "Startup to first byte: " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                *firstWrite - startTime).count() << " ms";
         }
 
+        bool success = RunJob(stopToken, printer, *contentType, options.NativeRaster, rasterFd);
+
         Log::Debug() << "Releasing unit...";
         printer.GoOffline();
         printer.ReleaseUnit();
         Log::Debug() << "Unit released";
         return success ? CUPS_BACKEND_OK : CUPS_BACKEND_FAILED;
-    } catch (const Capt::UnexpectedBehaviourError& e) {
-        Log::Critical() << "Protocol fault: " << e.what();
-    } catch (const UsbError& e) {
-        Log::Critical() << "USB backend error: " << e.what() << " (" << e.StrErrcode() << ')';
-    } catch (const RasterError& e) {
-        Log::Critical() << "Raster error: " << e.what();
-    } catch (const std::exception& e) {
-        Log::Critical() << "Unhandled exception: " << e.what();
+    } catch (...) {
+        LogJobError(std::current_exception());
     }
     return CUPS_BACKEND_FAILED;
 }
@@ -1,16 +1,27 @@
 message(STATUS "Summary")
-message(STATUS "  System                : ${CMAKE_SYSTEM_NAME}")
-message(STATUS "  C++ compiler          : ${CMAKE_CXX_COMPILER} ${CMAKE_CXX_COMPILER_ID} ${CMAKE_CXX_COMPILER_VERSION}")
-message(STATUS "  CMake version         : ${CMAKE_VERSION}")
-message(STATUS "  Build type            : ${CMAKE_BUILD_TYPE}")
-message(STATUS "  CXXFLAGS              : ${CMAKE_CXX_FLAGS}")
-message(STATUS "  CUPS_SERVER_BIN       : ${CUPS_SERVER_BIN}")
-message(STATUS "  CUPS_DATA_DIR         : ${CUPS_DATA_DIR}")
-message(STATUS "  CUPS_CFLAGS           : ${CUPS_CFLAGS}")
-message(STATUS "  CUPS_LDFLAGS          : ${CUPS_LDFLAGS}")
-message(STATUS "  CUPS_LIBS             : ${CUPS_LIBS}")
-message(STATUS "  CAPTPPD_BUILD_TESTS   : ${CAPTPPD_BUILD_TESTS}")
-message(STATUS "  CAPTPPD_COVERAGE      : ${CAPTPPD_COVERAGE}")
-message(STATUS "  CAPTPPD_SANITIZE      : ${CAPTPPD_SANITIZE}")
-message(STATUS "  CAPTPPD_DITHERING_OPT : ${CAPTPPD_DITHERING_OPT}")
-message(STATUS "  CAPTPPD_BACKEND_NAME  : ${CAPTPPD_BACKEND_NAME}")
+message(STATUS "  System                    : ${CMAKE_SYSTEM_NAME}")
+message(STATUS "  C++ compiler              : ${CMAKE_CXX_COMPILER} ${CMAKE_CXX_COMPILER_ID} ${CMAKE_CXX_COMPILER_VERSION}")
+message(STATUS "  CMake version             : ${CMAKE_VERSION}")
+message(STATUS "  Build type                : ${CMAKE_BUILD_TYPE}")
+message(STATUS "  CXXFLAGS                  : ${CMAKE_CXX_FLAGS}")
+message(STATUS "  CUPS_SERVER_BIN           : ${CUPS_SERVER_BIN}")
+message(STATUS "  CUPS_DATA_DIR             : ${CUPS_DATA_DIR}")
+message(STATUS "  CUPS_CFLAGS               : ${CUPS_CFLAGS}")
+message(STATUS "  CUPS_LDFLAGS              : ${CUPS_LDFLAGS}")
+message(STATUS "  CUPS_LIBS                 : ${CUPS_LIBS}")
+message(STATUS "  CAPTPPD_BUILD_TESTS       : ${CAPTPPD_BUILD_TESTS}")
+message(STATUS "  CAPTPPD_COVERAGE          : ${CAPTPPD_COVERAGE}")
+message(STATUS "  CAPTPPD_SANITIZE          : ${CAPTPPD_SANITIZE}")
+message(STATUS "  CAPTPPD_DITHERING_OPT     : ${CAPTPPD_DITHERING_OPT}")
+message(STATUS "  CAPTPPD_NATIVE_RASTER     : ${CAPTPPD_NATIVE_RASTER}")
+message(STATUS "  CAPTPPD_USB_ID_FILTER     : ${CAPTPPD_USB_ID_FILTER}")
+message(STATUS "  CAPTPPD_DAEMON            : ${CAPTPPD_DAEMON}")
+message(STATUS "  CAPTPPD_BACKEND_NAME      : ${CAPTPPD_BACKEND_NAME}")
+message(STATUS "  CAPTPPD_LOOKAHEAD_PAGES   : ${CAPTPPD_LOOKAHEAD_PAGES}")
+message(STATUS "  CAPTPPD_LOOKAHEAD_MEMORY  : ${CAPTPPD_LOOKAHEAD_MEMORY}")
+message(STATUS "  CAPTPPD_ENCODER_THREADS   : ${CAPTPPD_ENCODER_THREADS}")
+message(STATUS "  CAPTPPD_PAGE_CACHE_MEMORY : ${CAPTPPD_PAGE_CACHE_MEMORY}")
+message(STATUS "  CAPTPPD_PAGE_MEMORY       : ${CAPTPPD_PAGE_MEMORY}")
+message(STATUS "  CAPTPPD_PAGE_CACHE_DISK   : ${CAPTPPD_PAGE_CACHE_DISK}")
+message(STATUS "  CAPTPPD_USB_TRANSFERS     : ${CAPTPPD_USB_TRANSFERS}")
+message(STATUS "  CAPTPPD_DAEMON_LINGER     : ${CAPTPPD_DAEMON_LINGER}")
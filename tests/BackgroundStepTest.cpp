@@ -0,0 +1,66 @@
+#include "Core/BackgroundStep.hpp"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::literals::chrono_literals;
+
+TEST(BackgroundStepTest, Join) {
+    std::atomic<bool> ran = false;
+    BackgroundStep step([&](StopToken) {
+        ran = true;
+    });
+    step.Join(StopToken());
+    EXPECT_TRUE(ran);
+    // Joining again does nothing
+    step.Join(StopToken());
+}
+
+TEST(BackgroundStepTest, Error) {
+    BackgroundStep step([](StopToken) {
+        throw std::runtime_error("step failed");
+    });
+    EXPECT_THROW(step.Join(StopToken()), std::runtime_error);
+}
+
+// Like WaitReady() for a printer that is not ready, the step only returns when stopped
+static void blockUntilStopped(StopToken stopToken, std::atomic<bool>& started) {
+    started = true;
+    while (!stopToken.stop_requested()) {
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+TEST(BackgroundStepTest, CancelWhileJoining) {
+    std::atomic<bool> started = false;
+    BackgroundStep step([&](StopToken stopToken) {
+        blockUntilStopped(stopToken, started);
+    });
+    StopSource job;
+    std::thread cancel([&] {
+        while (!started) {
+            std::this_thread::sleep_for(1ms);
+        }
+        std::this_thread::sleep_for(20ms);
+        job.request_stop();
+    });
+    auto start = std::chrono::steady_clock::now();
+    step.Join(job.get_token());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+    cancel.join();
+}
+
+TEST(BackgroundStepTest, StopOnDestruction) {
+    std::atomic<bool> started = false;
+    {
+        BackgroundStep step([&](StopToken stopToken) {
+            blockUntilStopped(stopToken, started);
+        });
+        while (!started) {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+    SUCCEED();
+}
@@ -0,0 +1,58 @@
+#include "Cups/CupsOptions.hpp"
+#include "Config.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+static constexpr std::size_t MiB = 1024 * 1024;
+
+TEST(CupsOptionsTest, Defaults) {
+    PrintOptions defaults;
+    PrintOptions options = ParsePrintOptions("1", "");
+    EXPECT_EQ(options.Copies, 1u);
+    EXPECT_EQ(options.LookaheadPages, defaults.LookaheadPages);
+    EXPECT_EQ(options.LookaheadMemory, defaults.LookaheadMemory);
+    EXPECT_EQ(options.PageMemory, defaults.PageMemory);
+}
+
+TEST(CupsOptionsTest, Numbers) {
+    PrintOptions options = ParsePrintOptions("2", "capt-lookahead-pages=4 capt-lookahead-memory=32 capt-page-cache-memory=0");
+    EXPECT_EQ(options.Copies, 2u);
+    EXPECT_EQ(options.LookaheadPages, 4u);
+    EXPECT_EQ(options.LookaheadMemory, 32 * MiB);
+    EXPECT_EQ(options.PageCacheMemory, 0u);
+}
+
+// The options come from any user who can print
+TEST(CupsOptionsTest, Limits) {
+    PrintOptions defaults;
+    PrintOptions options = ParsePrintOptions("1", "capt-lookahead-pages=1000000 capt-lookahead-memory=4096 capt-page-memory=99999");
+    EXPECT_EQ(options.LookaheadPages, 32u);
+    EXPECT_EQ(options.LookaheadMemory, 1024 * MiB);
+    EXPECT_EQ(options.PageMemory, 1024 * MiB);
+
+    // Sizes that do not fit in bytes are rejected, not wrapped
+    options = ParsePrintOptions("1", "capt-page-memory=18446744073709551615 capt-page-cache-memory=17592186044416 capt-lookahead-pages=-1");
+    EXPECT_EQ(options.PageMemory, defaults.PageMemory);
+    EXPECT_EQ(options.PageCacheMemory, defaults.PageCacheMemory);
+    EXPECT_EQ(options.LookaheadPages, defaults.LookaheadPages);
+}
+
+TEST(CupsOptionsTest, EncoderThreads) {
+    EXPECT_EQ(ParsePrintOptions("1", "capt-encoder-threads=1").EncoderThreads, 1u);
+    EXPECT_EQ(ParsePrintOptions("1", "capt-encoder-threads=0").EncoderThreads, 0u);
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    EXPECT_EQ(ParsePrintOptions("1", "capt-encoder-threads=4000000").EncoderThreads, cores);
+}
+
+TEST(CupsOptionsTest, UsbTransfers) {
+    EXPECT_EQ(ParsePrintOptions("1", "capt-usb-transfers=0").UsbTransfers, 0u);
+    EXPECT_EQ(ParsePrintOptions("1", "capt-usb-transfers=8").UsbTransfers, 8u);
+    EXPECT_EQ(ParsePrintOptions("1", "capt-usb-transfers=100000").UsbTransfers, 16u);
+}
+
+TEST(CupsOptionsTest, DaemonLinger) {
+    EXPECT_EQ(ParsePrintOptions("1", "capt-daemon-linger=0").DaemonLinger, 0u);
+    EXPECT_EQ(ParsePrintOptions("1", "capt-daemon-linger=4294967295").DaemonLinger, static_cast<unsigned>(CAPTBACKEND_DAEMON_LINGER));
+}
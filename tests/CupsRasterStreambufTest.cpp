@@ -0,0 +1,144 @@
+#include "Cups/CupsRasterStreambuf.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <span>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static constexpr unsigned Pages = 3;
+static constexpr unsigned Width = 4960;
+static constexpr unsigned Height = 7014;
+static constexpr unsigned LineSize = Width / 8;
+
+// Text-like content: blank margins, short dark runs and repeated lines
+static void fillLine(std::vector<unsigned char>& line, unsigned page, unsigned y) {
+    std::fill(line.begin(), line.end(), 0);
+    if (y < 300 || y > Height - 300 || (y / 40) % 3 == 0) {
+        return;
+    }
+    for (unsigned x = 40; x < LineSize - 40; x++) {
+        std::uint32_t v = (x * 2654435761u) ^ ((y / 2) * 40503u) ^ page;
+        line[x] = (v >> 13) % 5 == 0 ? static_cast<unsigned char>(v) : 0;
+    }
+}
+
+class CupsRasterStreambufTest : public testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        this->path = testing::TempDir() + "CupsRasterStreambufTest.ras";
+        int fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        ASSERT_GE(fd, 0);
+        cups_raster_t* raster = cupsRasterOpen(fd, CUPS_RASTER_WRITE_COMPRESSED);
+        ASSERT_NE(raster, nullptr);
+
+        cups_page_header2_t header;
+        std::memset(&header, 0, sizeof(header));
+        header.HWResolution[0] = 600;
+        header.HWResolution[1] = 600;
+        header.cupsWidth = Width;
+        header.cupsHeight = Height;
+        header.cupsBitsPerColor = 1;
+        header.cupsBitsPerPixel = 1;
+        header.cupsBytesPerLine = LineSize;
+        header.cupsColorOrder = CUPS_ORDER_CHUNKED;
+        header.cupsColorSpace = CUPS_CSPACE_K;
+        header.cupsNumColors = 1;
+        header.cupsPageSize[0] = 595;
+        header.cupsPageSize[1] = 842;
+        header.cupsImagingBBox[2] = 595;
+        header.cupsImagingBBox[3] = 842;
+        header.cupsInteger[0] = 4768;
+        header.cupsInteger[1] = 6784;
+        header.cupsInteger[2] = 2;
+        std::strcpy(header.cupsPageSizeName, "A4");
+
+        std::vector<unsigned char> line(LineSize);
+        for (unsigned page = 0; page < Pages; page++) {
+            ASSERT_TRUE(cupsRasterWriteHeader2(raster, &header));
+            for (unsigned y = 0; y < Height; y++) {
+                fillLine(line, page, y);
+                ASSERT_EQ(cupsRasterWritePixels(raster, line.data(), line.size()), line.size());
+            }
+        }
+        cupsRasterClose(raster);
+        close(fd);
+    }
+
+    void TearDown() override {
+        unlink(this->path.c_str());
+    }
+
+    // Reads all pages with NextLine() like the crop and encoder stages do, returns decode time per page
+    std::chrono::nanoseconds readAll(std::size_t stripSize) {
+        CupsRasterStreambuf raster(stripSize);
+        EXPECT_TRUE(raster.Open(this->path.c_str()));
+        std::vector<unsigned char> expected(LineSize);
+        auto start = std::chrono::steady_clock::now();
+        unsigned page = 0;
+        while (auto params = raster.NextPage()) {
+            EXPECT_EQ(params->ImageLineSize, LineSize);
+            EXPECT_EQ(params->ImageLines, Height);
+            for (unsigned y = 0; y < Height; y++) {
+                std::span<const char> line = raster.NextLine();
+                EXPECT_EQ(line.size(), LineSize);
+                fillLine(expected, page, y);
+                if (line.size() != LineSize || std::memcmp(line.data(), expected.data(), LineSize) != 0) {
+                    ADD_FAILURE() << "page " << page << " line " << y << " mismatch";
+                    return {};
+                }
+            }
+            EXPECT_TRUE(raster.NextLine().empty());
+            page++;
+        }
+        EXPECT_EQ(page, Pages);
+        return (std::chrono::steady_clock::now() - start) / Pages;
+    }
+};
+
+TEST_F(CupsRasterStreambufTest, LineMode) {
+    this->readAll(0);
+}
+
+TEST_F(CupsRasterStreambufTest, StripMode) {
+    this->readAll(CupsRasterStreambuf::DefaultStripSize);
+}
+
+TEST_F(CupsRasterStreambufTest, SmallStrip) {
+    // Strip smaller than a line falls back to one line per read
+    this->readAll(LineSize / 2);
+}
+
+// Byte-oriented consumers read whole lines past the strip buffer
+TEST_F(CupsRasterStreambufTest, Sgetn) {
+    CupsRasterStreambuf raster;
+    ASSERT_TRUE(raster.Open(this->path.c_str()));
+    std::vector<unsigned char> expected(LineSize);
+    std::vector<char> line(LineSize);
+    unsigned page = 0;
+    while (raster.NextPage()) {
+        for (unsigned y = 0; y < Height; y++) {
+            ASSERT_EQ(raster.sgetn(line.data(), line.size()), static_cast<std::streamsize>(line.size()));
+            fillLine(expected, page, y);
+            ASSERT_EQ(std::memcmp(line.data(), expected.data(), LineSize), 0) << "page " << page << " line " << y;
+        }
+        EXPECT_EQ(raster.sgetc(), std::char_traits<char>::eof());
+        page++;
+    }
+    EXPECT_EQ(page, Pages);
+}
+
+// Through NextLine() the line mode calls cupsRasterReadPixels once per line, the strip mode once per 64 KiB
+TEST_F(CupsRasterStreambufTest, DecodeTime) {
+    using namespace std::chrono;
+    auto line = duration_cast<microseconds>(this->readAll(0));
+    auto strip = duration_cast<microseconds>(this->readAll(CupsRasterStreambuf::DefaultStripSize));
+    RecordProperty("LineModeUsPerPage", static_cast<int>(line.count()));
+    RecordProperty("StripModeUsPerPage", static_cast<int>(strip.count()));
+}
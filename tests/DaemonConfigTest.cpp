@@ -0,0 +1,31 @@
+#include "Service/DaemonConfig.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Uris = std::vector<std::string>;
+
+TEST(DaemonConfigTest, Pools) {
+    std::istringstream in(
+        "# Office\n"
+        "Pool captusb://Canon/LBP3200?drv=capt&serial=A captusb://Canon/LBP3200?drv=capt&serial=B\n"
+        "\n"
+        "  Pool captusb://Canon/LBP3200?drv=capt&serial=B\tcaptusb://Canon/LBP3200?drv=capt&serial=C\n"
+        "Pool captusb://Canon/LBP810?drv=capt&serial=D\n"
+        "Linger 60\n"
+    );
+    DaemonConfig config = DaemonConfig::Parse(in);
+    ASSERT_EQ(config.Pools.size(), 2u);
+    EXPECT_EQ(config.PoolOf("captusb://Canon/LBP3200?drv=capt&serial=A"), Uris{"captusb://Canon/LBP3200?drv=capt&serial=B"});
+    // A printer in two pools shares its jobs with both
+    EXPECT_EQ(config.PoolOf("captusb://Canon/LBP3200?drv=capt&serial=B"),
+        (Uris{"captusb://Canon/LBP3200?drv=capt&serial=A", "captusb://Canon/LBP3200?drv=capt&serial=C"}));
+    // Single printers and unlisted ones are not pooled
+    EXPECT_TRUE(config.PoolOf("captusb://Canon/LBP810?drv=capt&serial=D").empty());
+    EXPECT_TRUE(config.PoolOf("captusb://Canon/LBP3200?drv=capt&serial=E").empty());
+}
+
+TEST(DaemonConfigTest, Missing) {
+    EXPECT_TRUE(DaemonConfig::Load("/nonexistent/captusb.conf").Pools.empty());
+}
@@ -0,0 +1,84 @@
+#include "Core/DeviceCache.hpp"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static constexpr const char* DeviceId = "MFG:Canon;MDL:LBP3200;CMD:CAPT;VER:1.0;CLS:PRINTER;DES:Canon LBP3200";
+
+class DeviceCacheTest : public testing::Test {
+protected:
+    fs::path dir;
+    fs::path path;
+
+    void SetUp() override {
+        this->dir = fs::temp_directory_path() / ("DeviceCacheTest-" + std::to_string(getpid()));
+        this->path = this->dir / "devices";
+        fs::remove_all(this->dir);
+    }
+
+    void TearDown() override {
+        fs::remove_all(this->dir);
+    }
+};
+
+TEST_F(DeviceCacheTest, Persist) {
+    {
+        DeviceCache cache(this->path);
+        EXPECT_FALSE(cache.Find("001-1@002 04a9:2636:0100:3"));
+        cache.Insert("001-1@002 04a9:2636:0100:3", PrinterInfo::Parse(DeviceId, "98765432"));
+        cache.Insert("001-2@003 04a9:262b:0100:3", PrinterInfo::Parse(DeviceId, "12345678"));
+        cache.Save();
+    }
+    DeviceCache cache(this->path);
+    auto info = cache.Find("001-1@002 04a9:2636:0100:3");
+    ASSERT_TRUE(info);
+    EXPECT_EQ(info->DeviceId, DeviceId);
+    EXPECT_EQ(info->Model, "LBP3200");
+    EXPECT_EQ(info->Serial, "98765432");
+    EXPECT_FALSE(cache.Find("001-1@004 04a9:2636:0100:3"));
+
+    // Only the entry looked up is kept
+    cache.Prune();
+    cache.Save();
+    DeviceCache pruned(this->path);
+    EXPECT_TRUE(pruned.Find("001-1@002 04a9:2636:0100:3"));
+    EXPECT_FALSE(pruned.Find("001-2@003 04a9:262b:0100:3"));
+
+    pruned.Insert("001-2@003 04a9:262b:0100:3", PrinterInfo::Parse(DeviceId, "12345678"));
+    pruned.Erase("001-2@003 04a9:262b:0100:3");
+    pruned.Save();
+    DeviceCache erased(this->path);
+    EXPECT_TRUE(erased.Find("001-1@002 04a9:2636:0100:3"));
+    EXPECT_FALSE(erased.Find("001-2@003 04a9:262b:0100:3"));
+
+    erased.Clear();
+    erased.Save();
+    EXPECT_FALSE(DeviceCache(this->path).Find("001-1@002 04a9:2636:0100:3"));
+}
+
+TEST_F(DeviceCacheTest, Invalid) {
+    fs::create_directories(this->dir);
+    std::ofstream(this->path) << "CAPTDC1\ndamaged\nkey\tserial\t" << DeviceId << '\n';
+    DeviceCache cache(this->path);
+    EXPECT_TRUE(cache.Find("key"));
+    EXPECT_FALSE(cache.Find("damaged"));
+
+    // Fields with separators are not stored
+    cache.Insert("other", PrinterInfo::Parse(DeviceId, "bad\tserial"));
+    EXPECT_FALSE(cache.Find("other"));
+
+    std::ofstream(this->path) << "CAPTDC0\nkey\tserial\t" << DeviceId << '\n';
+    EXPECT_FALSE(DeviceCache(this->path).Find("key"));
+}
+
+TEST_F(DeviceCacheTest, Disabled) {
+    DeviceCache cache;
+    cache.Insert("key", PrinterInfo::Parse(DeviceId, "98765432"));
+    EXPECT_FALSE(cache.Find("key"));
+    cache.Save();
+    EXPECT_FALSE(fs::exists(this->path));
+}
@@ -0,0 +1,118 @@
+#include "Core/LineCropStreambuf.hpp"
+#include "Core/PageBuffer.hpp"
+#include "Core/RasterPage.hpp"
+#include "TestHelpers.hpp"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A4 at 600 dpi
+static constexpr unsigned LineSize = 4960 / 8;
+static constexpr unsigned Lines = 7014;
+
+enum class Content {
+    Blank,
+    Text,
+    Halftone,
+    Noise,
+};
+
+static std::string makePage(Content content) {
+    std::string page(LineSize * Lines, '\0');
+    std::mt19937 rng(static_cast<unsigned>(content));
+    for (unsigned y = 0; y < Lines; y++) {
+        char* line = page.data() + y * LineSize;
+        switch (content) {
+        case Content::Blank:
+            break;
+        case Content::Text:
+            // 40 px text lines with short words and blank leading between them
+            if (y % 100 < 40) {
+                for (unsigned x = 40; x < LineSize - 40; x++) {
+                    line[x] = (x / 8 + y / 100) % 5 != 0 ? static_cast<char>(rng() & 0x66) : 0;
+                }
+            }
+            break;
+        case Content::Halftone:
+            for (unsigned x = 0; x < LineSize; x++) {
+                line[x] = static_cast<char>(y % 4 < 2 ? 0xAA : 0x55);
+            }
+            break;
+        case Content::Noise:
+            for (unsigned x = 0; x < LineSize; x++) {
+                line[x] = static_cast<char>(rng());
+            }
+            break;
+        }
+    }
+    return page;
+}
+
+// Reference output, the encoder reading the raster byte by byte from a plain stream
+static std::string encodeReference(const std::string& page) {
+    std::stringbuf raster(page);
+    Capt::Compression::ScoaStreambuf ss;
+    ss.Reset(raster, LineSize, Lines);
+    return readAll(ss);
+}
+
+class EncodePageTest : public testing::TestWithParam<Content> {};
+
+TEST_P(EncodePageTest, SameAsReference) {
+    const std::string page = makePage(GetParam());
+    const std::string expected = encodeReference(page);
+    Capt::Compression::ScoaStreambuf encoder;
+
+    MemoryRaster lineRaster(page, LineSize);
+    LineCropStreambuf lines(lineRaster, LineSize, Lines);
+    PageBuffer fromLines = EncodePage(encoder, 0, pageParams(LineSize, Lines), lines);
+    EXPECT_TRUE(readAll(fromLines) == expected) << "line-by-line input differs";
+
+    MemoryRaster pageRaster(page, LineSize);
+    RasterPage rasterPage;
+    rasterPage.Load(pageRaster, LineSize, Lines);
+    PageBuffer fromPage = EncodePage(encoder, 1, pageParams(LineSize, Lines), rasterPage);
+    EXPECT_TRUE(readAll(fromPage) == expected) << "whole page input differs";
+    EXPECT_EQ(fromPage.PageNumber, 1u);
+}
+
+TEST_P(EncodePageTest, Sink) {
+    const std::string page = makePage(GetParam());
+    const std::string expected = encodeReference(page);
+    Capt::Compression::ScoaStreambuf encoder;
+    MemoryRaster raster(page, LineSize);
+    RasterPage rasterPage;
+    rasterPage.Load(raster, LineSize, Lines);
+
+    // The sink sees the page first, the returned page holds the same data
+    std::string sent;
+    PageSink sink = [&sent](PageTee& data) {
+        EXPECT_EQ(data.PageNumber, 2u);
+        sent = readAll(data);
+    };
+    PageBuffer encoded = EncodePage(encoder, 2, pageParams(LineSize, Lines), rasterPage, nullptr, &sink);
+    EXPECT_TRUE(sent == expected);
+    EXPECT_TRUE(readAll(encoded) == expected);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Corpus,
+    EncodePageTest,
+    testing::Values(Content::Blank, Content::Text, Content::Halftone, Content::Noise),
+    [](const testing::TestParamInfo<Content>& info) {
+        switch (info.param) {
+        case Content::Blank:
+            return "Blank";
+        case Content::Text:
+            return "Text";
+        case Content::Halftone:
+            return "Halftone";
+        case Content::Noise:
+            return "Noise";
+        }
+        return "Unknown";
+    }
+);
@@ -0,0 +1,35 @@
+#include "Core/EncoderPool.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+TEST(EncoderPoolTest, Threads) {
+    EncoderPool pool(3);
+    EXPECT_EQ(pool.Threads(), 3u);
+    EncoderPool perCore;
+    EXPECT_GE(perCore.Threads(), 1u);
+}
+
+TEST(EncoderPoolTest, RunsAllTasks) {
+    std::atomic<unsigned> done = 0;
+    std::mutex mutex;
+    std::set<Capt::Compression::ScoaStreambuf*> encoders;
+    {
+        EncoderPool pool(2);
+        for (unsigned i = 0; i < 20; i++) {
+            pool.Submit([&](Capt::Compression::ScoaStreambuf& encoder) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                std::lock_guard<std::mutex> lock(mutex);
+                encoders.insert(&encoder);
+                done++;
+            });
+        }
+        // Destruction runs the queued tasks
+    }
+    EXPECT_EQ(done, 20u);
+    // One encoder per thread
+    EXPECT_LE(encoders.size(), 2u);
+}
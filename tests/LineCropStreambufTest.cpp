@@ -0,0 +1,33 @@
+#include "Core/LineCropStreambuf.hpp"
+#include "Core/RasterError.hpp"
+#include "TestHelpers.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+TEST(LineCropStreambufTest, Crop) {
+    MemoryRaster raster({"abcdef", "ghijkl", "mnopqr", "stuvwx"});
+    LineCropStreambuf crop(raster, 4, 2);
+    std::string out(16, '\0');
+    out.resize(crop.sgetn(out.data(), out.size()));
+    EXPECT_EQ(out, "abcdghij");
+    EXPECT_EQ(raster.Requested, 2u);
+
+    crop.Drain();
+    EXPECT_EQ(raster.Requested, 5u);
+    EXPECT_EQ(crop.sgetc(), std::char_traits<char>::eof());
+}
+
+TEST(LineCropStreambufTest, ZeroCopy) {
+    MemoryRaster raster({"abcdef"});
+    LineCropStreambuf crop(raster, 6, 1);
+    ASSERT_EQ(crop.sgetc(), 'a');
+    EXPECT_EQ(crop.in_avail(), 6);
+}
+
+TEST(LineCropStreambufTest, ShortPage) {
+    MemoryRaster raster({"abcdef"});
+    LineCropStreambuf crop(raster, 4, 2);
+    std::string out(8, '\0');
+    EXPECT_THROW(crop.sgetn(out.data(), out.size()), RasterError);
+}
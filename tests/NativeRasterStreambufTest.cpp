@@ -0,0 +1,198 @@
+#include "Cups/NativeRasterStreambuf.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <span>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+static constexpr unsigned Pages = 2;
+static constexpr unsigned Width = 2400;
+static constexpr unsigned Height = 1200;
+static constexpr unsigned LineSize = Width / 8;
+
+static void fillLine(std::vector<unsigned char>& line, unsigned page, unsigned y) {
+    std::fill(line.begin(), line.end(), 0);
+    if ((y / 16) % 4 == 0) {
+        return;
+    }
+    for (unsigned x = 0; x < LineSize; x++) {
+        std::uint32_t v = (x * 2654435761u) ^ ((y / 3) * 40503u) ^ (page * 7919u);
+        if (x % 50 < 20) {
+            line[x] = static_cast<unsigned char>(v >> 7);
+        } else if (x % 50 < 30) {
+            line[x] = 0xff;
+        }
+    }
+}
+
+static cups_page_header2_t makeHeader() {
+    cups_page_header2_t header;
+    std::memset(&header, 0, sizeof(header));
+    header.HWResolution[0] = 600;
+    header.HWResolution[1] = 600;
+    header.cupsWidth = Width;
+    header.cupsHeight = Height;
+    header.cupsBitsPerColor = 1;
+    header.cupsBitsPerPixel = 1;
+    header.cupsBytesPerLine = LineSize;
+    header.cupsColorOrder = CUPS_ORDER_CHUNKED;
+    header.cupsColorSpace = CUPS_CSPACE_K;
+    header.cupsNumColors = 1;
+    header.cupsPageSize[0] = 288;
+    header.cupsPageSize[1] = 144;
+    header.cupsImagingBBox[2] = 288;
+    header.cupsImagingBBox[3] = 144;
+    std::strcpy(header.cupsPageSizeName, "Test");
+    return header;
+}
+
+static std::uint32_t bswap(std::uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+enum class Format { Compressed, Uncompressed, Swapped };
+
+class NativeRasterStreambufTest : public testing::TestWithParam<std::tuple<Format, bool>> {
+protected:
+    std::string path;
+    std::string fifoPath;
+
+    void SetUp() override {
+        this->path = testing::TempDir() + "NativeRasterStreambufTest.ras";
+        this->fifoPath = testing::TempDir() + "NativeRasterStreambufTest.fifo";
+        Format format = std::get<0>(GetParam());
+        if (format == Format::Swapped) {
+            this->writeSwapped();
+            return;
+        }
+        int fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        ASSERT_GE(fd, 0);
+        cups_raster_t* raster = cupsRasterOpen(fd, format == Format::Compressed ? CUPS_RASTER_WRITE_COMPRESSED : CUPS_RASTER_WRITE);
+        ASSERT_NE(raster, nullptr);
+        cups_page_header2_t header = makeHeader();
+        std::vector<unsigned char> line(LineSize);
+        for (unsigned page = 0; page < Pages; page++) {
+            ASSERT_TRUE(cupsRasterWriteHeader2(raster, &header));
+            for (unsigned y = 0; y < Height; y++) {
+                fillLine(line, page, y);
+                ASSERT_EQ(cupsRasterWritePixels(raster, line.data(), line.size()), line.size());
+            }
+        }
+        cupsRasterClose(raster);
+        close(fd);
+    }
+
+    // v3 stream produced on a host with the opposite byte order
+    void writeSwapped() {
+        std::ofstream out(this->path, std::ios::binary);
+        std::uint32_t sync = bswap(0x52615333);
+        out.write(reinterpret_cast<const char*>(&sync), sizeof(sync));
+        cups_page_header2_t header = makeHeader();
+        unsigned char* words = reinterpret_cast<unsigned char*>(&header) + offsetof(cups_page_header2_t, AdvanceDistance);
+        for (unsigned i = 0; i < 81; i++) {
+            std::uint32_t v;
+            std::memcpy(&v, words + i * 4, 4);
+            v = bswap(v);
+            std::memcpy(words + i * 4, &v, 4);
+        }
+        std::vector<unsigned char> line(LineSize);
+        for (unsigned page = 0; page < Pages; page++) {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (unsigned y = 0; y < Height; y++) {
+                fillLine(line, page, y);
+                out.write(reinterpret_cast<const char*>(line.data()), line.size());
+            }
+        }
+    }
+
+    void TearDown() override {
+        unlink(this->path.c_str());
+        unlink(this->fifoPath.c_str());
+    }
+};
+
+TEST_P(NativeRasterStreambufTest, Read) {
+    bool pipe = std::get<1>(GetParam());
+    std::thread writer;
+    NativeRasterStreambuf raster;
+    if (pipe) {
+        ASSERT_EQ(mkfifo(this->fifoPath.c_str(), 0600), 0);
+        writer = std::thread([this] {
+            std::ifstream in(this->path, std::ios::binary);
+            std::ofstream out(this->fifoPath, std::ios::binary);
+            out << in.rdbuf();
+        });
+        ASSERT_TRUE(raster.Open(this->fifoPath.c_str()));
+    } else {
+        ASSERT_TRUE(raster.Open(this->path.c_str()));
+    }
+
+    std::vector<unsigned char> expected(LineSize);
+    std::vector<char> line(LineSize);
+    unsigned page = 0;
+    while (auto params = raster.NextPage()) {
+        EXPECT_EQ(params->ImageLineSize, LineSize);
+        EXPECT_EQ(params->ImageLines, Height);
+        for (unsigned y = 0; y < Height; y++) {
+            // Mix bulk and per-byte reads
+            if (y % 2 == 0) {
+                ASSERT_EQ(raster.sgetn(line.data(), line.size()), static_cast<std::streamsize>(line.size()));
+            } else {
+                for (char& c : line) {
+                    int ch = raster.sbumpc();
+                    ASSERT_NE(ch, std::char_traits<char>::eof());
+                    c = static_cast<char>(ch);
+                }
+            }
+            fillLine(expected, page, y);
+            ASSERT_EQ(std::memcmp(line.data(), expected.data(), LineSize), 0) << "page " << page << " line " << y;
+        }
+        EXPECT_EQ(raster.sgetc(), std::char_traits<char>::eof());
+        page++;
+    }
+    EXPECT_EQ(page, Pages);
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+TEST_P(NativeRasterStreambufTest, ReadLines) {
+    if (std::get<1>(GetParam())) {
+        GTEST_SKIP() << "covered by Read";
+    }
+    NativeRasterStreambuf raster;
+    ASSERT_TRUE(raster.Open(this->path.c_str()));
+    std::vector<unsigned char> expected(LineSize);
+    unsigned page = 0;
+    while (raster.NextPage()) {
+        for (unsigned y = 0; y < Height; y++) {
+            std::span<const char> line = raster.NextLine();
+            ASSERT_EQ(line.size(), LineSize);
+            fillLine(expected, page, y);
+            ASSERT_EQ(std::memcmp(line.data(), expected.data(), LineSize), 0) << "page " << page << " line " << y;
+        }
+        EXPECT_TRUE(raster.NextLine().empty());
+        page++;
+    }
+    EXPECT_EQ(page, Pages);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Formats, NativeRasterStreambufTest,
+    testing::Combine(testing::Values(Format::Compressed, Format::Uncompressed, Format::Swapped), testing::Bool())
+);
+
+TEST(NativeRasterStreambufInvalidTest, BadSync) {
+    std::string path = testing::TempDir() + "NativeRasterStreambufInvalidTest.ras";
+    std::ofstream(path, std::ios::binary) << "NotARasterFile";
+    NativeRasterStreambuf raster;
+    EXPECT_FALSE(raster.Open(path.c_str()));
+    unlink(path.c_str());
+}
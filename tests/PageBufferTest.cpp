@@ -0,0 +1,128 @@
+#include "Core/PageBuffer.hpp"
+#include "TestHelpers.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+
+static std::string makeData(std::size_t size) {
+    std::string data(size, '\0');
+    std::mt19937 rng(static_cast<unsigned>(size));
+    for (char& c : data) {
+        c = static_cast<char>(rng());
+    }
+    return data;
+}
+
+TEST(PageBufferTest, Memory) {
+    const std::string data = makeData(200 * 1024);
+    std::stringbuf src(data);
+    PageStore store(1024 * 1024);
+    PageBuffer page(3, pageParams(100, 200), src, &store);
+    EXPECT_FALSE(page.Spilled());
+    EXPECT_EQ(page.PageNumber, 3u);
+    EXPECT_EQ(page.Params.ImageLines, 200u);
+    EXPECT_TRUE(page.ToString() == data);
+    EXPECT_TRUE(readAll(page) == data);
+
+    // Replay
+    page.pubseekpos(0);
+    EXPECT_TRUE(readAll(page) == data);
+    EXPECT_EQ(page.pubseekoff(-10, std::ios_base::end), std::streampos(data.size() - 10));
+    EXPECT_TRUE(readAll(page) == data.substr(data.size() - 10));
+
+    // Seeking across and to the end of the chunks
+    EXPECT_EQ(page.pubseekpos(PageStore::ChunkSize + 1), std::streampos(PageStore::ChunkSize + 1));
+    EXPECT_TRUE(readAll(page) == data.substr(PageStore::ChunkSize + 1));
+    EXPECT_EQ(page.pubseekpos(data.size()), std::streampos(data.size()));
+    EXPECT_EQ(page.sgetc(), std::char_traits<char>::eof());
+}
+
+TEST(PageBufferTest, Recycle) {
+    const std::string data = makeData(3 * PageStore::ChunkSize);
+    PageStore store(4 * PageStore::ChunkSize);
+    store.Prefill(4 * PageStore::ChunkSize);
+    // Chunks of a released page are reused for the next one and stay within the budget
+    for (unsigned i = 0; i < 10; i++) {
+        PageBuffer page(i, pageParams(100, 200), data, &store);
+        EXPECT_FALSE(page.Spilled());
+        EXPECT_TRUE(readAll(page) == data);
+    }
+    PageBuffer first(0, pageParams(100, 200), data, &store);
+    PageBuffer second(1, pageParams(100, 200), data, &store);
+    EXPECT_FALSE(first.Spilled());
+    EXPECT_TRUE(second.Spilled());
+    EXPECT_TRUE(second.ToString() == data);
+}
+
+TEST(PageBufferTest, Spill) {
+    const std::string small = makeData(1000);
+    const std::string large = makeData(300 * 1024 + 7);
+    PageStore store(128 * 1024);
+    PageBuffer first(0, pageParams(100, 200), small, &store);
+    EXPECT_FALSE(first.Spilled());
+    PageBuffer second(1, pageParams(100, 200), large, &store);
+    EXPECT_TRUE(second.Spilled());
+    EXPECT_TRUE(second.ToString() == large);
+    EXPECT_TRUE(readAll(second) == large);
+    second.pubseekpos(0);
+    EXPECT_TRUE(readAll(second) == large);
+
+    // The memory of the spilled page has been returned to the budget
+    PageBuffer third(2, pageParams(100, 200), makeData(64 * 1024), &store);
+    EXPECT_FALSE(third.Spilled());
+}
+
+TEST(PageBufferTest, SpillEmpty) {
+    PageStore store(0);
+    PageBuffer page(0, pageParams(100, 200), std::string_view(), &store);
+    EXPECT_EQ(page.Size(), 0u);
+    EXPECT_EQ(page.sgetc(), std::char_traits<char>::eof());
+}
+
+TEST(PageBufferTest, Copy) {
+    const std::string data = makeData(1000);
+    PageBuffer page(0, pageParams(100, 200), data);
+    EXPECT_EQ(page.sbumpc(), static_cast<unsigned char>(data[0]));
+
+    // Copies share the data, but start from the beginning
+    PageBuffer copy = page;
+    copy.PageNumber = 1;
+    EXPECT_TRUE(readAll(copy) == data);
+    EXPECT_TRUE(readAll(page) == data.substr(1));
+    EXPECT_EQ(page.PageNumber, 0u);
+
+    PageBuffer moved = std::move(copy);
+    EXPECT_TRUE(readAll(moved) == data);
+    EXPECT_EQ(copy.Size(), 0u);
+    EXPECT_EQ(copy.sgetc(), std::char_traits<char>::eof());
+}
+
+TEST(PageBufferTest, Tee) {
+    const std::string data = makeData(200 * 1024 + 3);
+    std::stringbuf src(data);
+    PageStore store(1024 * 1024);
+    PageTee tee(5, pageParams(100, 200), src, &store);
+    std::string head(1000, '\0');
+    EXPECT_EQ(tee.sgetn(head.data(), 1000), 1000);
+    EXPECT_TRUE(head == data.substr(0, 1000));
+
+    // The rest is read by Finish(), the tee is at the end after that
+    PageBuffer page = tee.Finish();
+    EXPECT_EQ(tee.sgetc(), std::char_traits<char>::eof());
+    EXPECT_EQ(page.PageNumber, 5u);
+    EXPECT_FALSE(page.Spilled());
+    EXPECT_TRUE(readAll(page) == data);
+    EXPECT_TRUE(tee.Finish().ToString() == data);
+}
+
+TEST(PageBufferTest, TeeSpill) {
+    const std::string data = makeData(300 * 1024 + 7);
+    std::stringbuf src(data);
+    PageStore store(128 * 1024);
+    PageTee tee(0, pageParams(100, 200), src, &store);
+    EXPECT_TRUE(readAll(tee) == data);
+    PageBuffer page = tee.Finish();
+    EXPECT_TRUE(page.Spilled());
+    EXPECT_TRUE(readAll(page) == data);
+}
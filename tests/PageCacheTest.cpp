@@ -0,0 +1,107 @@
+#include "Core/PageCache.hpp"
+#include "TestHelpers.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class PageCacheTest : public testing::Test {
+protected:
+    fs::path dir;
+
+    void SetUp() override {
+        this->dir = fs::temp_directory_path() / ("PageCacheTest-" + std::to_string(getpid()));
+        fs::remove_all(this->dir);
+    }
+
+    void TearDown() override {
+        fs::remove_all(this->dir);
+    }
+};
+
+TEST_F(PageCacheTest, Key) {
+    PageCache cache(1024);
+    std::string raster(1000, 'a');
+    PageCache::Key key = cache.MakeKey(raster, pageParams(10, 100));
+    EXPECT_EQ(key, cache.MakeKey(raster, pageParams(10, 100)));
+    EXPECT_NE(key, cache.MakeKey(raster, pageParams(20, 50)));
+    for (std::size_t i : {0u, 7u, 8u, 31u, 32u, 999u}) {
+        std::string other = raster;
+        other[i] ^= 1;
+        EXPECT_NE(key, cache.MakeKey(other, pageParams(10, 100))) << i;
+    }
+    EXPECT_NE(cache.MakeKey(std::string(999, 'a'), pageParams(10, 100)), cache.MakeKey(std::string(998, 'a'), pageParams(10, 100)));
+    // The digest is only computed for the disk tier
+    EXPECT_FALSE(key.Digest.has_value());
+}
+
+// Files of the disk tier are named after the SHA-256 of the raster
+TEST_F(PageCacheTest, DiskKey) {
+    PageCache cache(1024, this->dir, 1024 * 1024);
+    PageCache::Key key = cache.MakeKey(std::string("abc"), pageParams(1, 3));
+    ASSERT_TRUE(key.Digest.has_value());
+    EXPECT_EQ(key.FileName(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad-1x3");
+    EXPECT_NE(key, cache.MakeKey(std::string("abd"), pageParams(1, 3)));
+}
+
+TEST_F(PageCacheTest, Memory) {
+    PageCache cache(10);
+    PageCache::Key a = cache.MakeKey("a", pageParams(1, 1));
+    PageCache::Key b = cache.MakeKey("b", pageParams(1, 1));
+    PageCache::Key c = cache.MakeKey("c", pageParams(1, 1));
+    EXPECT_EQ(cache.Find(a), nullptr);
+    cache.Insert(a, "aaaa");
+    cache.Insert(b, "bbbb");
+    ASSERT_NE(cache.Find(a), nullptr);
+    EXPECT_EQ(*cache.Find(a), "aaaa");
+    // Evicts b, the least recently used
+    cache.Insert(c, "cccc");
+    EXPECT_EQ(cache.Find(b), nullptr);
+    EXPECT_NE(cache.Find(a), nullptr);
+    EXPECT_NE(cache.Find(c), nullptr);
+    // Larger than the whole cache
+    cache.Insert(b, std::string(11, 'b'));
+    EXPECT_EQ(cache.Find(b), nullptr);
+}
+
+TEST_F(PageCacheTest, Disk) {
+    PageCache::Key a;
+    {
+        PageCache cache(1024, this->dir, 1024 * 1024);
+        a = cache.MakeKey("a", pageParams(1, 1));
+        cache.Insert(a, "aaaa");
+    }
+    PageCache cache(1024, this->dir, 1024 * 1024);
+    PageCache::Key b = cache.MakeKey("b", pageParams(1, 1));
+    PageCache::Data data = cache.Find(a);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(*data, "aaaa");
+    EXPECT_EQ(cache.Find(b), nullptr);
+
+    // A damaged file is a miss
+    fs::resize_file(this->dir / a.FileName(), 10);
+    PageCache other(1024, this->dir, 1024 * 1024);
+    EXPECT_EQ(other.Find(a), nullptr);
+}
+
+TEST_F(PageCacheTest, DiskLimit) {
+    const std::string page(400, 'x');
+    PageCache::Key keys[3];
+    {
+        PageCache cache(0, this->dir, 1000);
+        for (int i = 0; i < 3; i++) {
+            keys[i] = cache.MakeKey(std::to_string(i), pageParams(1, 1));
+            cache.Insert(keys[i], page);
+            // Distinct modification times
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    PageCache cache(0, this->dir, 1000);
+    EXPECT_EQ(cache.Find(keys[0]), nullptr);
+    EXPECT_NE(cache.Find(keys[1]), nullptr);
+    EXPECT_NE(cache.Find(keys[2]), nullptr);
+}
@@ -0,0 +1,276 @@
+#include "Core/PagePipeline.hpp"
+#include "Core/StopToken.hpp"
+#include "TestHelpers.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using Page = PagePipeline::Page;
+using Job = PagePipeline::Job;
+
+static Job makeJob(unsigned n, std::chrono::milliseconds delay = {}) {
+    Capt::PageParams params = pageParams(4, 1);
+    return Job{params, [n, params, delay](Capt::Compression::ScoaStreambuf& encoder) {
+        std::this_thread::sleep_for(delay);
+        std::stringbuf buf(std::string(4, static_cast<char>(n)));
+        return EncodePage(encoder, n, params, buf);
+    }};
+}
+
+static std::string readAll(Page& page) {
+    page.pubseekpos(0);
+    std::ostringstream out;
+    out << &page;
+    return std::move(out).str();
+}
+
+// Look-ahead depth, encoder threads
+class PagePipelineTest : public testing::TestWithParam<std::tuple<unsigned, unsigned>> {};
+
+TEST_P(PagePipelineTest, Order) {
+    auto [depth, threads] = GetParam();
+    unsigned produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        if (produced == 10) {
+            return std::nullopt;
+        }
+        // Later pages finish first
+        unsigned n = produced++;
+        return makeJob(n, std::chrono::milliseconds(n % 3 == 0 ? 20 : 0));
+    }, depth, 1024, threads);
+
+    for (unsigned i = 0; i < 10; i++) {
+        std::optional<Page> page = pipeline.Next(StopToken());
+        ASSERT_TRUE(page.has_value());
+        EXPECT_EQ(page->PageNumber, i);
+        page->pubseekpos(0);
+        EXPECT_EQ(page->sgetc(), static_cast<int>(i));
+    }
+    EXPECT_FALSE(pipeline.Next(StopToken()).has_value());
+    EXPECT_FALSE(pipeline.Next(StopToken()).has_value());
+}
+
+TEST_P(PagePipelineTest, Error) {
+    auto [depth, threads] = GetParam();
+    unsigned produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        if (produced == 3) {
+            throw std::runtime_error("test");
+        }
+        return makeJob(produced++);
+    }, depth, 1024, threads);
+
+    for (unsigned i = 0; i < 3; i++) {
+        std::optional<Page> page = pipeline.Next(StopToken());
+        ASSERT_TRUE(page.has_value());
+        EXPECT_EQ(page->PageNumber, i);
+    }
+    EXPECT_THROW(pipeline.Next(StopToken()), std::runtime_error);
+}
+
+TEST_P(PagePipelineTest, EncodeError) {
+    auto [depth, threads] = GetParam();
+    unsigned produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        unsigned n = produced++;
+        if (n == 2) {
+            return Job{pageParams(4, 1), [](Capt::Compression::ScoaStreambuf&) -> Page {
+                throw std::runtime_error("test");
+            }};
+        }
+        return makeJob(n);
+    }, depth, 1024, threads);
+
+    for (unsigned i = 0; i < 2; i++) {
+        std::optional<Page> page = pipeline.Next(StopToken());
+        ASSERT_TRUE(page.has_value());
+        EXPECT_EQ(page->PageNumber, i);
+    }
+    EXPECT_THROW(pipeline.Next(StopToken()), std::runtime_error);
+}
+
+// The parallel encoders must produce exactly what a single encoder produces
+TEST_P(PagePipelineTest, SameAsSerial) {
+    auto [depth, threads] = GetParam();
+    constexpr unsigned lineSize = 620;
+    constexpr unsigned lines = 700;
+    std::vector<std::string> rasters;
+    std::mt19937 rng(1);
+    for (unsigned i = 0; i < 8; i++) {
+        std::string raster(lineSize * lines, '\0');
+        for (char& c : raster) {
+            c = static_cast<char>(rng() % (i + 1) == 0 ? rng() : 0);
+        }
+        rasters.push_back(std::move(raster));
+    }
+
+    unsigned produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        if (produced == rasters.size()) {
+            return std::nullopt;
+        }
+        unsigned n = produced++;
+        Capt::PageParams params = pageParams(lineSize, lines);
+        return Job{params, [&rasters, n, params](Capt::Compression::ScoaStreambuf& encoder) {
+            std::stringbuf buf(rasters[n]);
+            return EncodePage(encoder, n, params, buf);
+        }};
+    }, depth, 64 * 1024 * 1024, threads);
+
+    Capt::Compression::ScoaStreambuf serial;
+    for (unsigned i = 0; i < rasters.size(); i++) {
+        std::optional<Page> page = pipeline.Next(StopToken());
+        ASSERT_TRUE(page.has_value());
+        std::stringbuf buf(rasters[i]);
+        Page expected = EncodePage(serial, i, pageParams(lineSize, lines), buf);
+        EXPECT_TRUE(readAll(*page) == readAll(expected)) << "page " << i;
+    }
+    EXPECT_FALSE(pipeline.Next(StopToken()).has_value());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    DepthThreads,
+    PagePipelineTest,
+    testing::Values(
+        std::make_tuple(0u, 1u),
+        std::make_tuple(1u, 1u),
+        std::make_tuple(3u, 1u),
+        std::make_tuple(3u, 3u),
+        std::make_tuple(4u, 0u)
+    )
+);
+
+TEST(PagePipelineBudgetTest, Bounded) {
+    std::atomic<unsigned> produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        return makeJob(produced++);
+    }, 8, 8, 2);
+
+    // Wait until the reader blocks on the memory budget (2 pages of 4 bytes)
+    for (int i = 0; i < 100 && produced < 2; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(produced, 2u);
+
+    ASSERT_TRUE(pipeline.Next(StopToken()).has_value());
+    for (int i = 0; i < 100 && produced < 3; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(produced, 3u);
+}
+
+TEST(PagePipelineStopTest, StopWhileEncoding) {
+    unsigned produced = 0;
+    auto pipeline = std::make_unique<PagePipeline>([&]() -> std::optional<Job> {
+        return makeJob(produced++, std::chrono::milliseconds(20));
+    }, 4, 1024, 4);
+    ASSERT_TRUE(pipeline->Next(StopToken()).has_value());
+    pipeline->Stop();
+    pipeline.reset();
+}
+
+// Pipelines of printers running side by side share the encoder threads
+TEST(PagePipelinePoolTest, SharedPool) {
+    EncoderPool pool(2);
+    std::vector<std::thread> jobs;
+    std::atomic<unsigned> failures = 0;
+    for (unsigned j = 0; j < 3; j++) {
+        jobs.emplace_back([&pool, &failures] {
+            unsigned produced = 0;
+            PagePipeline pipeline([&]() -> std::optional<Job> {
+                if (produced == 10) {
+                    return std::nullopt;
+                }
+                unsigned n = produced++;
+                return makeJob(n, std::chrono::milliseconds(n % 3 == 0 ? 10 : 0));
+            }, 3, 1024, 1, &pool);
+            for (unsigned i = 0; i < 10; i++) {
+                std::optional<Page> page = pipeline.Next(StopToken());
+                if (!page || page->PageNumber != i) {
+                    failures++;
+                }
+            }
+            if (pipeline.Next(StopToken()).has_value()) {
+                failures++;
+            }
+        });
+    }
+    for (std::thread& job : jobs) {
+        job.join();
+    }
+    EXPECT_EQ(failures, 0u);
+}
+
+TEST(PagePipelinePoolTest, StopWhileEncoding) {
+    EncoderPool pool(1);
+    unsigned produced = 0;
+    auto pipeline = std::make_unique<PagePipeline>([&]() -> std::optional<Job> {
+        return makeJob(produced++, std::chrono::milliseconds(20));
+    }, 4, 1024, 1, &pool);
+    ASSERT_TRUE(pipeline->Next(StopToken()).has_value());
+    pipeline->Stop();
+    // Waits for the tasks already queued in the pool
+    pipeline.reset();
+}
+
+TEST(PagePipelinePendingTest, ReadAhead) {
+    unsigned produced = 0;
+    PagePipeline pipeline([&]() -> std::optional<Job> {
+        if (produced == 3) {
+            return std::nullopt;
+        }
+        return makeJob(produced++);
+    }, 4, 1024, 1);
+    for (int i = 0; i < 100 && pipeline.Pending() < 3; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(pipeline.Pending(), 3u);
+    ASSERT_TRUE(pipeline.Next(StopToken()).has_value());
+    EXPECT_EQ(pipeline.Pending(), 2u);
+    ASSERT_TRUE(pipeline.Next(StopToken()).has_value());
+    ASSERT_TRUE(pipeline.Next(StopToken()).has_value());
+    EXPECT_EQ(pipeline.Pending(), 0u);
+    EXPECT_FALSE(pipeline.Next(StopToken()).has_value());
+}
+
+// Pages are compressed in parallel, each on one thread: more threads shorten a job
+// of several dense pages, but not the wait for the first one
+TEST(PagePipelineLatencyTest, TimeToFirstByte) {
+    using namespace std::chrono;
+    constexpr milliseconds encodeTime(80);
+    constexpr unsigned pages = 4;
+    auto run = [&](unsigned threads) {
+        unsigned produced = 0;
+        auto start = steady_clock::now();
+        PagePipeline pipeline([&]() -> std::optional<Job> {
+            if (produced == pages) {
+                return std::nullopt;
+            }
+            return makeJob(produced++, encodeTime);
+        }, pages, 1024, threads);
+        EXPECT_TRUE(pipeline.Next(StopToken()).has_value());
+        auto firstByte = steady_clock::now() - start;
+        for (unsigned i = 1; i < pages; i++) {
+            EXPECT_TRUE(pipeline.Next(StopToken()).has_value());
+        }
+        return std::make_pair(firstByte, steady_clock::now() - start);
+    };
+    auto [serialFirst, serialTotal] = run(1);
+    auto [parallelFirst, parallelTotal] = run(pages);
+    RecordProperty("SerialFirstByteMs", static_cast<int>(duration_cast<milliseconds>(serialFirst).count()));
+    RecordProperty("ParallelFirstByteMs", static_cast<int>(duration_cast<milliseconds>(parallelFirst).count()));
+    EXPECT_GE(serialFirst, encodeTime);
+    EXPECT_GE(parallelFirst, encodeTime);
+    EXPECT_GE(serialTotal, encodeTime * pages);
+    EXPECT_LT(parallelTotal, encodeTime * pages);
+}
@@ -0,0 +1,119 @@
+#include "Core/PollScheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+static Capt::ExtendedStatus makeStatus(uint16_t engine, uint8_t basic = 0) noexcept {
+    Capt::ExtendedStatus status{};
+    status.Engine = static_cast<Capt::EngineReadyStatus>(engine);
+    status.Basic = static_cast<Capt::BasicStatus>(basic);
+    return status;
+}
+
+TEST(PollSchedulerTest, Backoff) {
+    PollScheduler scheduler(25ms, 2s);
+    Capt::ExtendedStatus printing = makeStatus(0);
+    EXPECT_EQ(scheduler.Next(printing), 25ms);
+    EXPECT_EQ(scheduler.Next(printing), 50ms);
+    EXPECT_EQ(scheduler.Next(printing), 100ms);
+    EXPECT_EQ(scheduler.Next(printing), 200ms);
+    EXPECT_EQ(scheduler.Next(printing), 250ms);
+    EXPECT_EQ(scheduler.Next(printing), 250ms);
+
+    // A change polls quickly again
+    Capt::ExtendedStatus shipped = printing;
+    shipped.Shipped = 1;
+    EXPECT_EQ(scheduler.Next(shipped), 25ms);
+    EXPECT_EQ(scheduler.Next(shipped), 50ms);
+
+    scheduler.Reset();
+    EXPECT_EQ(scheduler.Next(shipped), 25ms);
+}
+
+TEST(PollSchedulerTest, Limit) {
+    PollScheduler scheduler(25ms, 2s);
+    EXPECT_EQ(scheduler.Limit(makeStatus(Capt::EngineReadyStatus::WAITING)), 100ms);
+    EXPECT_EQ(scheduler.Limit(makeStatus(0, Capt::BasicStatus::IM_DATA_BUSY)), 100ms);
+    EXPECT_EQ(scheduler.Limit(makeStatus(0, Capt::BasicStatus::NOT_READY)), 500ms);
+    EXPECT_EQ(scheduler.Limit(makeStatus(Capt::EngineReadyStatus::DOOR_OPEN, Capt::BasicStatus::NOT_READY)), 2s);
+    EXPECT_EQ(scheduler.Limit(makeStatus(Capt::EngineReadyStatus::NO_PRINT_PAPER)), 2s);
+
+    // The limits stay within the intervals of the scheduler
+    PollScheduler fixed(10ms, 10ms);
+    EXPECT_EQ(fixed.Limit(makeStatus(Capt::EngineReadyStatus::JAM)), 10ms);
+    Capt::ExtendedStatus status = makeStatus(0);
+    EXPECT_EQ(fixed.Next(status), 10ms);
+    EXPECT_EQ(fixed.Next(status), 10ms);
+}
+
+// Polls over a simulated page, from the command starting it to the engine going idle,
+// compared with the fixed 100 ms interval the poller used before
+TEST(PollSchedulerTest, PageCycle) {
+    struct Phase {
+        std::chrono::milliseconds Duration;
+        Capt::ExtendedStatus Status;
+    };
+    Capt::ExtendedStatus printing = makeStatus(0);
+    printing.Printing = 1;
+    Capt::ExtendedStatus shipped = printing;
+    shipped.Shipped = 1;
+    Capt::ExtendedStatus waiting = shipped;
+    waiting.Engine = Capt::EngineReadyStatus::WAITING;
+    Capt::ExtendedStatus printed = shipped;
+    printed.Printed = 1;
+    std::vector<Phase> phases{
+        {230ms, makeStatus(0, Capt::BasicStatus::CMD_BUSY)},
+        {3070ms, makeStatus(0, Capt::BasicStatus::NOT_READY)},
+        {2040ms, printing},
+        {3950ms, shipped},
+        {310ms, waiting},
+        {1s, printed},
+    };
+
+    struct Result {
+        unsigned Polls = 0;
+        unsigned Seen = 0;
+        std::chrono::milliseconds MaxDelay{};
+    };
+    // Polls the phases at the intervals chosen by next(), the delay is from a change to the poll seeing it
+    auto simulate = [&](const std::function<std::chrono::milliseconds(const Capt::ExtendedStatus&)>& next) {
+        Result result;
+        std::chrono::milliseconds t{};
+        std::chrono::milliseconds start{};
+        std::size_t last = phases.size();
+        for (std::size_t i = 0; i < phases.size(); i++) {
+            while (t < start + phases[i].Duration) {
+                result.Polls++;
+                if (i != last) {
+                    result.Seen++;
+                    result.MaxDelay = std::max(result.MaxDelay, t - start);
+                    last = i;
+                }
+                t += next(phases[i].Status);
+            }
+            start += phases[i].Duration;
+        }
+        return result;
+    };
+
+    PollScheduler scheduler(25ms, 2s);
+    scheduler.Reset();
+    Result scheduled = simulate([&](const Capt::ExtendedStatus& status) { return scheduler.Next(status); });
+    Result fixed = simulate([](const Capt::ExtendedStatus&) { return 100ms; });
+    RecordProperty("ScheduledPolls", static_cast<int>(scheduled.Polls));
+    RecordProperty("FixedPolls", static_cast<int>(fixed.Polls));
+    RecordProperty("ScheduledMaxDelayMs", static_cast<int>(scheduled.MaxDelay.count()));
+    RecordProperty("FixedMaxDelayMs", static_cast<int>(fixed.MaxDelay.count()));
+
+    EXPECT_EQ(fixed.Polls, 106u);
+    EXPECT_EQ(scheduled.Seen, phases.size());
+    EXPECT_EQ(fixed.Seen, phases.size());
+    // About half the polls of the fixed interval (54 of 106), for changes seen up to 250 ms late instead of 70 ms.
+    // A change is always seen within the longest limit of the page.
+    EXPECT_LE(scheduled.Polls * 10, fixed.Polls * 6);
+    EXPECT_LE(scheduled.MaxDelay, 500ms);
+}
@@ -0,0 +1,128 @@
+#include "Service/Protocol.hpp"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class ProtocolTest : public testing::Test {
+protected:
+    int client = -1;
+    int server = -1;
+
+    void SetUp() override {
+        int sv[2];
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+        this->client = sv[0];
+        this->server = sv[1];
+    }
+
+    void TearDown() override {
+        for (int fd : {this->client, this->server}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+};
+
+TEST_F(ProtocolTest, Request) {
+    JobRequest request{
+        .Uri = "usb://Canon/LBP2900?serial=0000A1B2C3D4",
+        .ContentType = "application/vnd.cups-raster",
+        .Copies = "2",
+        .Options = "capt-daemon=true collate",
+        .Linger = 45,
+    };
+    int pipeFds[2];
+    ASSERT_EQ(pipe(pipeFds), 0);
+    ASSERT_TRUE(SendRequest(this->client, request, pipeFds[0], STDERR_FILENO));
+    close(pipeFds[0]);
+
+    int rasterFd;
+    int logFd;
+    auto received = ReceiveRequest(this->server, rasterFd, logFd);
+    ASSERT_TRUE(received.has_value());
+    EXPECT_EQ(received->Uri, request.Uri);
+    EXPECT_EQ(received->ContentType, request.ContentType);
+    EXPECT_EQ(received->Copies, request.Copies);
+    EXPECT_EQ(received->Options, request.Options);
+    EXPECT_EQ(received->Linger, request.Linger);
+    ASSERT_GE(rasterFd, 0);
+    ASSERT_GE(logFd, 0);
+
+    // The received descriptor refers to the same pipe
+    char c = 'x';
+    ASSERT_EQ(write(pipeFds[1], &c, 1), 1);
+    char r = 0;
+    EXPECT_EQ(read(rasterFd, &r, 1), 1);
+    EXPECT_EQ(r, c);
+    close(pipeFds[1]);
+    close(rasterFd);
+    close(logFd);
+}
+
+TEST_F(ProtocolTest, RequestWithoutRaster) {
+    JobRequest request{
+        .Uri = "usb://Canon/LBP3000",
+        .ContentType = "application/vnd.cups-command",
+        .Copies = "1",
+        .Options = "",
+        .Linger = 30,
+    };
+    ASSERT_TRUE(SendRequest(this->client, request, -1, STDERR_FILENO));
+    int rasterFd;
+    int logFd;
+    auto received = ReceiveRequest(this->server, rasterFd, logFd);
+    ASSERT_TRUE(received.has_value());
+    EXPECT_EQ(rasterFd, -1);
+    EXPECT_GE(logFd, 0);
+    close(logFd);
+}
+
+TEST_F(ProtocolTest, InvalidRequest) {
+    const char garbage[] = "CAPTJOB0";
+    ASSERT_EQ(send(this->client, garbage, sizeof(garbage), 0), static_cast<ssize_t>(sizeof(garbage)));
+    int rasterFd;
+    int logFd;
+    EXPECT_FALSE(ReceiveRequest(this->server, rasterFd, logFd).has_value());
+    EXPECT_EQ(rasterFd, -1);
+    EXPECT_EQ(logFd, -1);
+}
+
+TEST_F(ProtocolTest, ExtraDescriptors) {
+    int pipeFds[2];
+    ASSERT_EQ(pipe2(pipeFds, O_NONBLOCK), 0);
+    const char garbage[] = "CAPTJOB0";
+    iovec iov{const_cast<char*>(garbage), sizeof(garbage)};
+    int fds[3] = {pipeFds[1], pipeFds[1], pipeFds[1]};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    ASSERT_EQ(sendmsg(this->client, &msg, 0), static_cast<ssize_t>(sizeof(garbage)));
+    close(pipeFds[1]);
+
+    int rasterFd;
+    int logFd;
+    EXPECT_FALSE(ReceiveRequest(this->server, rasterFd, logFd).has_value());
+    // Every copy of the write end is closed, so the pipe is at its end
+    char c;
+    EXPECT_EQ(read(pipeFds[0], &c, 1), 0);
+    close(pipeFds[0]);
+}
+
+TEST_F(ProtocolTest, Result) {
+    ASSERT_TRUE(SendResult(this->server, 4));
+    EXPECT_EQ(ReceiveResult(this->client), 4);
+    close(this->server);
+    this->server = -1;
+    EXPECT_FALSE(ReceiveResult(this->client).has_value());
+}
@@ -0,0 +1,248 @@
+#include "Core/RangeSplitter.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+// Pages of two lines, every byte of a page is its number
+class PagesRaster : public RasterStreambuf {
+private:
+    unsigned pages;
+    unsigned page = 0;
+    unsigned line = 0;
+    std::string lineData;
+public:
+    std::atomic<unsigned> Read = 0;
+
+    explicit PagesRaster(unsigned pages) noexcept : pages(pages) {}
+
+    std::optional<Capt::PageParams> NextPage() override {
+        if (this->page == this->pages) {
+            return std::nullopt;
+        }
+        this->lineData.assign(4, static_cast<char>(this->page++));
+        this->Read++;
+        this->line = 0;
+        Capt::PageParams params{};
+        params.ImageLineSize = 4;
+        params.ImageLines = 2;
+        return params;
+    }
+
+    std::span<const char> NextLine() override {
+        if (this->line == 2) {
+            return {};
+        }
+        this->line++;
+        return {this->lineData.data(), this->lineData.size()};
+    }
+};
+
+// Reads the pages and checks that they come in order within each range
+static std::vector<unsigned> readAll(RangeSplitter::Reader& reader) {
+    std::vector<unsigned> pages;
+    while (reader.NextPage()) {
+        std::span<const char> first = reader.NextLine();
+        std::span<const char> second = reader.NextLine();
+        EXPECT_EQ(first.size(), 4u);
+        EXPECT_EQ(second.size(), 4u);
+        EXPECT_TRUE(reader.NextLine().empty());
+        pages.push_back(static_cast<unsigned char>(first[0]));
+    }
+    return pages;
+}
+
+TEST(RangeSplitterTest, SingleReader) {
+    PagesRaster raster(7);
+    RangeSplitter splitter(raster, 3, 1 << 20);
+    RangeSplitter::Reader& reader = splitter.AddReader();
+    EXPECT_EQ(readAll(reader), (std::vector<unsigned>{0, 1, 2, 3, 4, 5, 6}));
+    // The last page is only sent once the printer has finished
+    EXPECT_EQ(reader.Printed(), (std::vector<RangeSplitter::Range>{}));
+    reader.Starting(6);
+    EXPECT_EQ(reader.Printed(), (std::vector<RangeSplitter::Range>{{0, 6}}));
+    reader.Finish();
+    EXPECT_EQ(reader.Printed(), (std::vector<RangeSplitter::Range>{{0, 7}}));
+}
+
+TEST(RangeSplitterTest, Interleaved) {
+    PagesRaster raster(10);
+    RangeSplitter splitter(raster, 4, 1 << 20);
+    RangeSplitter::Reader& a = splitter.AddReader();
+    RangeSplitter::Reader& b = splitter.AddReader();
+    // a takes 0-3, b takes 4-7 and reads a's pages on the way
+    ASSERT_TRUE(a.NextPage());
+    ASSERT_TRUE(b.NextPage());
+    EXPECT_EQ(static_cast<unsigned char>(b.NextLine()[0]), 4);
+    std::vector<unsigned> restA = readAll(a);
+    std::vector<unsigned> restB = readAll(b);
+    EXPECT_EQ(restA, (std::vector<unsigned>{1, 2, 3, 8, 9}));
+    EXPECT_EQ(restB, (std::vector<unsigned>{5, 6, 7}));
+    a.Finish();
+    b.Finish();
+    EXPECT_EQ(a.Printed(), (std::vector<RangeSplitter::Range>{{0, 4}, {8, 10}}));
+    EXPECT_EQ(b.Printed(), (std::vector<RangeSplitter::Range>{{4, 8}}));
+    // Pages keep their numbers in the job
+    EXPECT_EQ(a.Taken(), 6u);
+    EXPECT_EQ(a.PageNumber(0), 0u);
+    EXPECT_EQ(a.PageNumber(4), 8u);
+    EXPECT_EQ(b.PageNumber(0), 4u);
+}
+
+TEST(RangeSplitterTest, Empty) {
+    PagesRaster raster(0);
+    RangeSplitter splitter(raster, 4, 1 << 20);
+    RangeSplitter::Reader& reader = splitter.AddReader();
+    EXPECT_FALSE(reader.NextPage());
+    reader.Finish();
+    EXPECT_TRUE(reader.Printed().empty());
+}
+
+// Every page is printed exactly once, in contiguous ranges
+TEST(RangeSplitterTest, Concurrent) {
+    PagesRaster raster(200);
+    RangeSplitter splitter(raster, 5, 1 << 20);
+    std::mutex mutex;
+    std::multiset<unsigned> seen;
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < 4; i++) {
+        RangeSplitter::Reader* reader = &splitter.AddReader();
+        threads.emplace_back([&, reader, i] {
+            std::vector<unsigned> pages;
+            while (reader->NextPage()) {
+                pages.push_back(static_cast<unsigned char>(reader->NextLine()[0]));
+                std::this_thread::sleep_for(std::chrono::microseconds(100 * (i + 1)));
+            }
+            reader->Finish();
+            std::vector<unsigned> expected;
+            for (auto [first, last] : reader->Printed()) {
+                EXPECT_EQ(first % 5, 0u);
+                for (unsigned p = first; p < last; p++) {
+                    expected.push_back(p % 256);
+                }
+            }
+            EXPECT_EQ(pages, expected);
+            std::lock_guard<std::mutex> lock(mutex);
+            seen.insert(pages.begin(), pages.end());
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(seen.size(), 200u);
+    for (unsigned p = 0; p < 200; p++) {
+        EXPECT_EQ(seen.count(p), 1u) << p;
+    }
+}
+
+// The pages a failed reader has not sent go to the other one
+TEST(RangeSplitterTest, Fail) {
+    PagesRaster raster(12);
+    RangeSplitter splitter(raster, 4, 1 << 20);
+    RangeSplitter::Reader& a = splitter.AddReader();
+    RangeSplitter::Reader& b = splitter.AddReader();
+    // a takes 0-3 and reads ahead to page 2, b takes 4-7
+    ASSERT_TRUE(a.NextPage());
+    ASSERT_TRUE(a.NextPage());
+    ASSERT_TRUE(a.NextPage());
+    ASSERT_TRUE(b.NextPage());
+    // a fails while printing page 1
+    a.Starting(1);
+    EXPECT_EQ(a.Fail(), (std::vector<RangeSplitter::Range>{{1, 4}}));
+    EXPECT_EQ(a.Printed(), (std::vector<RangeSplitter::Range>{{0, 1}}));
+    EXPECT_EQ(splitter.Left(), 3u);
+    EXPECT_EQ(readAll(b), (std::vector<unsigned>{1, 2, 3, 5, 6, 7, 8, 9, 10, 11}));
+    b.Finish();
+    EXPECT_EQ(b.Printed(), (std::vector<RangeSplitter::Range>{{1, 12}}));
+    EXPECT_EQ(splitter.Left(), 0u);
+}
+
+// A reader failing after the others have finished leaves its pages for another round
+TEST(RangeSplitterTest, FailLast) {
+    PagesRaster raster(6);
+    RangeSplitter splitter(raster, 3, 1 << 20);
+    RangeSplitter::Reader& a = splitter.AddReader();
+    RangeSplitter::Reader& b = splitter.AddReader();
+    ASSERT_TRUE(a.NextPage());
+    EXPECT_EQ(readAll(b), (std::vector<unsigned>{3, 4, 5}));
+    b.Finish();
+    // Page 0 is being printed, the ones after it have not been taken
+    EXPECT_EQ(a.Fail(), (std::vector<RangeSplitter::Range>{{0, 3}}));
+    EXPECT_EQ(splitter.Left(), 3u);
+    EXPECT_EQ(readAll(b), (std::vector<unsigned>{0, 1, 2}));
+    b.Finish();
+    EXPECT_EQ(b.Printed(), (std::vector<RangeSplitter::Range>{{0, 6}}));
+}
+
+// Every page is printed once although a reader fails on the way
+TEST(RangeSplitterTest, ConcurrentFail) {
+    PagesRaster raster(200);
+    RangeSplitter splitter(raster, 5, 1 << 20);
+    std::vector<RangeSplitter::Reader*> readers;
+    for (unsigned i = 0; i < 4; i++) {
+        readers.push_back(&splitter.AddReader());
+    }
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < 4; i++) {
+        threads.emplace_back([&, i] {
+            RangeSplitter::Reader& reader = *readers[i];
+            for (unsigned taken = 0; reader.NextPage(); taken++) {
+                reader.Starting(taken);
+                std::this_thread::sleep_for(std::chrono::microseconds(100 * (i + 1)));
+                if (i == 0 && taken == 12) {
+                    reader.Fail();
+                    return;
+                }
+            }
+            reader.Finish();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    // The first round may end before the failure
+    if (splitter.Left() != 0) {
+        RangeSplitter::Reader& reader = *readers[1];
+        readAll(reader);
+        reader.Finish();
+    }
+    std::multiset<unsigned> printed;
+    for (RangeSplitter::Reader* reader : readers) {
+        for (auto [first, last] : reader->Printed()) {
+            for (unsigned p = first; p < last; p++) {
+                printed.insert(p);
+            }
+        }
+    }
+    EXPECT_EQ(printed.size(), 200u);
+    for (unsigned p = 0; p < 200; p++) {
+        EXPECT_EQ(printed.count(p), 1u) << p;
+    }
+}
+
+// Pages read for a reader that does not take them wait for room
+TEST(RangeSplitterTest, MemoryBudget) {
+    PagesRaster raster(20);
+    // Two pages of eight bytes
+    RangeSplitter splitter(raster, 10, 16);
+    RangeSplitter::Reader& a = splitter.AddReader();
+    RangeSplitter::Reader& b = splitter.AddReader();
+    ASSERT_TRUE(a.NextPage());
+    std::vector<unsigned> pagesB;
+    std::thread thread([&] {
+        pagesB = readAll(b);
+    });
+    std::this_thread::sleep_for(50ms);
+    // Page 0 has been taken, 1-2 wait for a
+    EXPECT_EQ(raster.Read, 3u);
+    std::vector<unsigned> pagesA = readAll(a);
+    thread.join();
+    EXPECT_EQ(pagesA, (std::vector<unsigned>{1, 2, 3, 4, 5, 6, 7, 8, 9}));
+    EXPECT_EQ(pagesB, (std::vector<unsigned>{10, 11, 12, 13, 14, 15, 16, 17, 18, 19}));
+}
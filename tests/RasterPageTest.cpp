@@ -0,0 +1,146 @@
+#include "Core/BlankLine.hpp"
+#include "Core/Downsample.hpp"
+#include "Core/RasterPage.hpp"
+#include "TestHelpers.hpp"
+#include <gtest/gtest.h>
+#include <libcapt/Utility/Crop.hpp>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+TEST(RasterPageTest, IsBlankLine) {
+    std::vector<char> line(300 + 1);
+    for (std::size_t size = 0; size < 300; size++) {
+        // Offset by one byte to check unaligned loads
+        std::span<const char> span(line.data() + 1, size);
+        ASSERT_TRUE(IsBlankLine(span)) << size;
+        for (std::size_t i = 0; i < size; i++) {
+            line[1 + i] = 0x01;
+            ASSERT_FALSE(IsBlankLine(span)) << size << ' ' << i;
+            ASSERT_EQ(IsBlankLine(span), IsBlankLineScalar(span));
+            line[1 + i] = 0;
+        }
+        line[0] = 0x7F;
+        line[1 + size] = 0x7F;
+        ASSERT_TRUE(IsBlankLine(span)) << size;
+        line[0] = 0;
+        line[1 + size] = 0;
+    }
+}
+
+TEST(RasterPageTest, BlankBands) {
+    const std::string blank(6, '\0');
+    MemoryRaster raster({blank, blank, std::string("ab\0\0\0\0", 6), blank, std::string("\0\0\0\0cd", 6), blank, blank, blank, "ignored"});
+    RasterPage page;
+    page.Load(raster, 4, 8);
+    EXPECT_EQ(raster.NextLine().size(), 0u);
+    ASSERT_EQ(page.Lines(), 8u);
+    // The cropped column does not count as ink
+    EXPECT_EQ(page.BlankBands(), std::make_pair(2u, 5u));
+
+    page.SetWindow(2, 2);
+    std::string out(16, 'x');
+    out.resize(page.sgetn(out.data(), out.size()));
+    EXPECT_EQ(out, std::string("ab\0\0\0\0\0\0", 8));
+}
+
+TEST(RasterPageTest, BlankPage) {
+    const std::string blank(4, '\0');
+    MemoryRaster raster({blank, blank, blank});
+    RasterPage page;
+    page.Load(raster, 4, 3);
+    EXPECT_EQ(page.BlankBands(), std::make_pair(3u, 0u));
+}
+
+static bool pixel(const std::string& line, std::size_t x) noexcept {
+    return x / 8 < line.size() && (static_cast<unsigned char>(line[x / 8]) & (0x80 >> (x % 8))) != 0;
+}
+
+TEST(RasterPageTest, Downsample) {
+    std::mt19937 rng(1);
+    for (unsigned lineSize : {1u, 2u, 15u, 16u, 17u, 40u}) {
+        for (unsigned lines : {1u, 2u, 7u}) {
+            std::vector<std::string> src;
+            for (unsigned y = 0; y < lines; y++) {
+                std::string line(lineSize, '\0');
+                for (char& c : line) {
+                    // Sparse pixels, so that the OR is not always black
+                    c = static_cast<char>(rng() & rng() & rng());
+                }
+                src.push_back(line);
+            }
+            MemoryRaster raster(src);
+            RasterPage page;
+            page.Load(raster, lineSize, lines);
+            page.Downsample();
+            ASSERT_EQ(page.LineSize(), (lineSize + 1) / 2);
+            ASSERT_EQ(page.Lines(), (lines + 1) / 2);
+
+            for (unsigned y = 0; y < page.Lines(); y++) {
+                std::string line(page.Line(y).data(), page.LineSize());
+                for (std::size_t x = 0; x < page.LineSize() * 8; x++) {
+                    bool expected = false;
+                    for (unsigned dy = 0; dy < 2; dy++) {
+                        if (2 * y + dy < lines) {
+                            expected |= pixel(src[2 * y + dy], 2 * x) || pixel(src[2 * y + dy], 2 * x + 1);
+                        }
+                    }
+                    ASSERT_EQ(pixel(line, x), expected) << lineSize << 'x' << lines << " at " << x << ',' << y;
+                }
+            }
+            EXPECT_EQ(page.Window().size(), page.LineSize() * page.Lines());
+        }
+    }
+}
+
+// A4 as given by the PPD, in 600 dpi dots at both resolutions
+static Capt::PageParams a4Params(Capt::ResolutionIdx resolution, uint16_t lineSize, uint16_t lines) noexcept {
+    Capt::PageParams params{};
+    params.Resolution = resolution;
+    params.ImageLineSize = lineSize;
+    params.ImageLines = lines;
+    params.PaperWidth = 4960;
+    params.PaperHeight = 7014;
+    return params;
+}
+
+TEST(RasterPageTest, Crop) {
+    Capt::PageParams params = a4Params(Capt::ResolutionIdx::RES_600, 640, 7100);
+    CropPageParams(params);
+    EXPECT_EQ(params.ImageLineSize, Capt::Utility::CropLineSize(640, 4960));
+    EXPECT_EQ(params.ImageLines, Capt::Utility::CropLinesCount(7100, 7014));
+
+    // The same paper holds half as many 300 dpi dots
+    params = a4Params(Capt::ResolutionIdx::RES_300, 320, 3550);
+    CropPageParams(params);
+    EXPECT_EQ(params.Resolution, Capt::ResolutionIdx::RES_300);
+    EXPECT_EQ(params.ImageLineSize, Capt::Utility::CropLineSize(320, 2480));
+    EXPECT_EQ(params.ImageLines, Capt::Utility::CropLinesCount(3550, 3507));
+    EXPECT_LE(params.ImageLines, 3507u);
+}
+
+TEST(RasterPageTest, DownsampleParams) {
+    MemoryRaster raster(std::vector<std::string>(7, std::string(15, '\x55')));
+    RasterPage page;
+    page.Load(raster, 15, 7);
+    Capt::PageParams params = a4Params(Capt::ResolutionIdx::RES_600, 15, 7);
+    params.MarginLeft = 95;
+    params.MarginTop = 84;
+    page.Downsample(params);
+    EXPECT_EQ(params.Resolution, Capt::ResolutionIdx::RES_300);
+    EXPECT_EQ(params.ImageLineSize, 8u);
+    EXPECT_EQ(params.ImageLines, 4u);
+    EXPECT_EQ(params.MarginLeft, 47u);
+    EXPECT_EQ(params.MarginTop, 42u);
+    // Paper size stays in 600 dpi dots
+    EXPECT_EQ(params.PaperWidth, 4960u);
+    EXPECT_EQ(params.PaperHeight, 7014u);
+    EXPECT_EQ(page.Window().size(), 8u * 4u);
+
+    // The top margin does not drop to 0
+    page.Load(raster, 15, 0);
+    params.MarginTop = 1;
+    page.Downsample(params);
+    EXPECT_EQ(params.MarginTop, 1u);
+}
@@ -196,3 +196,39 @@ TEST_F(StateReporterTest, FatalOverlap) {
     Update({.Engine = EngineReadyStatus::SERVICE_CALL | EngineReadyStatus::JAM});
     EXPECT_THAT(Parser.Reasons, testing::UnorderedElementsAre("other-error"));
 }
+
+TEST_F(StateReporterTest, SharedJob) {
+    {
+        StateReporter first(Reporter, [](unsigned page) { return page + 10; });
+        StateReporter second(Reporter, [](unsigned page) { return page + 20; });
+
+        first.Update(Status{.Engine = EngineReadyStatus::JAM}.Make());
+        second.Update(Status{.Engine = EngineReadyStatus::JAM | EngineReadyStatus::DOOR_OPEN}.Make());
+        Parse();
+        EXPECT_THAT(Parser.Reasons, testing::UnorderedElementsAre("media-jam-error", "door-open-error"));
+
+        // A reason stays while another printer reports it
+        first.Update(Status{}.Make());
+        Parse();
+        EXPECT_THAT(Parser.Reasons, testing::UnorderedElementsAre("media-jam-error", "door-open-error"));
+        second.Update(Status{.Engine = EngineReadyStatus::DOOR_OPEN}.Make());
+        Parse();
+        EXPECT_THAT(Parser.Reasons, testing::UnorderedElementsAre("door-open-error"));
+
+        // Pages are numbered within the job
+        first.Page(1);
+        Parse();
+        EXPECT_EQ(Parser.Page, 11);
+        second.Page(2);
+        Parse();
+        EXPECT_EQ(Parser.Page, 22);
+
+        first.Update(Status{.Engine = EngineReadyStatus::DOOR_OPEN}.Make());
+        first.Clear();
+        Parse();
+        EXPECT_THAT(Parser.Reasons, testing::UnorderedElementsAre("door-open-error"));
+    }
+    // The reasons of a printer are cleared when it leaves the job
+    Parse();
+    EXPECT_EQ(Parser.Reasons.size(), 0);
+}
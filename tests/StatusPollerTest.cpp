@@ -0,0 +1,59 @@
+#include "Core/StatusPoller.hpp"
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace std::literals::chrono_literals;
+
+static Capt::ExtendedStatus makeStatus(uint16_t start) noexcept {
+    Capt::ExtendedStatus status{};
+    status.Start = start;
+    return status;
+}
+
+TEST(StatusPollerTest, Wait) {
+    std::atomic<uint16_t> polls = 0;
+    StatusPoller* self = nullptr;
+    StatusPoller poller([&] {
+        self->Publish(makeStatus(++polls));
+    }, 1ms, 1h);
+    self = &poller;
+    poller.Start();
+
+    // Waiters switch the poller to the fast interval
+    auto snapshot = poller.Wait(StopToken(), [](const Capt::ExtendedStatus& status) {
+        return status.Start >= 5;
+    }, 10s);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_GE(snapshot->Status.Start, 5);
+    EXPECT_EQ(poller.Latest()->Sequence, poller.NextSequence() - 1);
+
+    // A status published after the call is required
+    unsigned long after = poller.NextSequence();
+    snapshot = poller.Wait(StopToken(), [](const Capt::ExtendedStatus&) { return true; }, 10s, after);
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_GE(snapshot->Sequence, after);
+    poller.Stop();
+}
+
+TEST(StatusPollerTest, Timeout) {
+    StatusPoller poller([] {}, 1ms, 1h);
+    poller.Publish(makeStatus(1));
+    auto start = std::chrono::steady_clock::now();
+    auto snapshot = poller.Wait(StopToken(), [](const Capt::ExtendedStatus& status) {
+        return status.Start == 2;
+    }, 50ms);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 50ms);
+    // The latest status is returned anyway
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(snapshot->Status.Start, 1);
+}
+
+TEST(StatusPollerTest, Error) {
+    StatusPoller poller([] {
+        throw std::runtime_error("poll failed");
+    }, 1ms, 1ms);
+    poller.Start();
+    EXPECT_THROW(poller.Wait(StopToken(), [](const Capt::ExtendedStatus&) { return true; }, 10s), std::runtime_error);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Core/RasterStreambuf.hpp"
+#include <libcapt/Protocol/PageParams.hpp>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Page of raster served line by line from memory
+class MemoryRaster : public RasterStreambuf {
+private:
+    std::vector<std::string> lines;
+    std::size_t next = 0;
+public:
+    // Calls of NextLine(), including the ones past the last line
+    unsigned Requested = 0;
+
+    explicit MemoryRaster(std::vector<std::string> lines) : lines(std::move(lines)) {}
+
+    // Splits page into lines of lineSize bytes
+    explicit MemoryRaster(std::string_view page, std::size_t lineSize) {
+        for (std::size_t offset = 0; offset < page.size(); offset += lineSize) {
+            this->lines.emplace_back(page.substr(offset, lineSize));
+        }
+    }
+
+    std::optional<Capt::PageParams> NextPage() override {
+        return std::nullopt;
+    }
+
+    std::span<const char> NextLine() override {
+        this->Requested++;
+        if (this->next == this->lines.size()) {
+            return {};
+        }
+        const std::string& line = this->lines[this->next++];
+        return {line.data(), line.size()};
+    }
+};
+
+inline Capt::PageParams pageParams(unsigned lineSize, unsigned lines) noexcept {
+    Capt::PageParams params{};
+    params.ImageLineSize = lineSize;
+    params.ImageLines = lines;
+    return params;
+}
+
+// Reads buf from its current position to the end
+inline std::string readAll(std::streambuf& buf) {
+    std::ostringstream out;
+    out << &buf;
+    return std::move(out).str();
+}